@@ -0,0 +1,266 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+/*
+    Graph evaluation benchmarks.
+
+    Build with Google Benchmark from the repository root:
+
+        g++ -std=c++14 -O2 -I. benchmark/benchmark.cpp df.cpp df_parallel.cpp df_jit.cpp \
+            -lbenchmark -pthread -ldl -o df_benchmark
+
+    Each case reports the time per sample (time/sample) and the throughput
+    (samples/s), a sample being one evaluated frame of the whole graph.
+*/
+
+#include <benchmark/benchmark.h>
+#include "df.h"
+#include "df_jit.h"
+#include "df_lanes.h"
+#include "df_parallel.h"
+
+namespace {
+
+constexpr std::size_t BlockSize = 256;
+
+// Frames evaluated per iteration: zero means a single tick.
+void evaluate(df::Graph &g, std::size_t frames)
+{
+    if (frames == 0)
+        g.evaluate();
+    else
+        g.evaluate(frames);
+}
+
+// Samples are counted for each of the graph instances evaluated at once.
+void run(benchmark::State &state, df::Graph &g, std::size_t frames, std::size_t instances = 1)
+{
+    const std::size_t samples = (frames == 0 ? 1 : frames) * instances;
+
+    g.blockSize(frames);
+    evaluate(g, frames);
+
+    for (auto _ : state)
+        evaluate(g, frames);
+
+    const double total = double(state.iterations() * samples);
+    state.counters["samples/s"] = benchmark::Counter(total, benchmark::Counter::kIsRate);
+    state.counters["time/sample"] = benchmark::Counter(total, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+// Variables feeding a binary node.
+template <class N>
+void binaryNode(df::Graph &g)
+{
+    auto &a = g.variable<float>(1.5f);
+    auto &b = g.variable<float>(2.5f);
+    auto &n = g.node<N>();
+    a >> n.template in<0>();
+    b >> n.template in<1>();
+}
+
+// Chain of nodes, each depending on the previous one.
+void deepGraph(df::Graph &g, std::size_t size)
+{
+    auto &noise = g.noise<float>(-1, 1);
+    df::Output<float> *pLast = &noise.out<0>();
+
+    for (std::size_t i = 1; i < size; ++i) {
+        auto &add = g.add<float>();
+        *pLast >> add.in<0>();
+        noise.out<0>() >> add.in<1>();
+        pLast = &add.out<0>();
+    }
+}
+
+// Independent nodes reading the same source.
+void wideGraph(df::Graph &g, std::size_t size)
+{
+    auto &noise = g.noise<float>(-1, 1);
+
+    for (std::size_t i = 1; i < size; ++i) {
+        auto &mul = g.mul<float>();
+        noise.out<0>() >> mul.in<0>();
+        mul.in<1>() = 0.5f;
+    }
+}
+
+// See examples/sin_cos_generator.cpp
+template <typename T = float>
+void sinCosGraph(df::Graph &g)
+{
+    g.sampleRate(100.0);
+    auto &dt = g.variable<T>(T(float(g.timeStep())));
+
+    auto &csub = g.sub<T>();
+    auto &cmul = g.mul<T>();
+    auto &sadd = g.add<T>();
+    auto &smul = g.mul<T>();
+
+    csub.template out<0>() >> csub.template in<0>() >> cmul.template in<0>();
+    dt >> cmul.template in<1>();
+    smul.template out<0>() >> csub.template in<1>();
+
+    sadd.template out<0>() >> sadd.template in<0>() >> smul.template in<0>();
+    dt >> smul.template in<1>();
+    cmul.template out<0>() >> sadd.template in<1>();
+
+    csub.template out<0>() = T(1.0f);
+}
+
+std::size_t frames(const benchmark::State &state) { return std::size_t(state.range(0)); }
+
+df::Execution execution(const benchmark::State &state) { return df::Execution(state.range(2)); }
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+// Single node cost, per tick (0) and per block.
+
+template <class N>
+void BM_BinaryNode(benchmark::State &state)
+{
+    df::Graph g;
+    binaryNode<N>(g);
+    run(state, g, frames(state));
+}
+
+void BM_WhiteNoise(benchmark::State &state)
+{
+    df::Graph g;
+    g.noise<float>(-1, 1);
+    run(state, g, frames(state));
+}
+
+BENCHMARK_TEMPLATE(BM_BinaryNode, df::node::Add<float>)->Arg(0)->Arg(BlockSize);
+BENCHMARK_TEMPLATE(BM_BinaryNode, df::node::Mul<float>)->Arg(0)->Arg(BlockSize);
+BENCHMARK_TEMPLATE(BM_BinaryNode, df::node::Div<float>)->Arg(0)->Arg(BlockSize);
+BENCHMARK(BM_WhiteNoise)->Arg(0)->Arg(BlockSize);
+
+//----------------------------------------------------------
+// Synthetic graphs: frames, number of nodes, execution strategy.
+
+void graphArguments(benchmark::internal::Benchmark *b)
+{
+    for (int execution : { int(df::Execution::Serial), int(df::Execution::Levels), int(df::Execution::WorkStealing) }) {
+        for (int size = 10; size <= 100000; size *= 10) {
+            b->Args({ 0, size, execution });
+            b->Args({ int(BlockSize), size, execution });
+        }
+    }
+}
+
+void BM_DeepGraph(benchmark::State &state)
+{
+    df::Graph g;
+    deepGraph(g, std::size_t(state.range(1)));
+    g.executor(df::makeExecutor(execution(state)));
+    run(state, g, frames(state));
+}
+
+void BM_WideGraph(benchmark::State &state)
+{
+    df::Graph g;
+    wideGraph(g, std::size_t(state.range(1)));
+    g.executor(df::makeExecutor(execution(state)));
+    run(state, g, frames(state));
+}
+
+BENCHMARK(BM_DeepGraph)->Apply(graphArguments)->ArgNames({ "frames", "nodes", "execution" });
+BENCHMARK(BM_WideGraph)->Apply(graphArguments)->ArgNames({ "frames", "nodes", "execution" });
+
+//----------------------------------------------------------
+// Feedback loops, evaluated frame by frame even in block mode.
+
+void BM_SinCos(benchmark::State &state)
+{
+    df::Graph g;
+    sinCosGraph(g);
+    run(state, g, frames(state));
+}
+
+BENCHMARK(BM_SinCos)->Arg(0)->Arg(BlockSize);
+
+// Same graph, evaluated over 64 instances at once.
+void BM_SinCosLanes(benchmark::State &state)
+{
+    using Lanes = df::Lanes<float, 64>;
+
+    df::Graph g;
+    sinCosGraph<Lanes>(g);
+    run(state, g, frames(state), Lanes::Size);
+}
+
+BENCHMARK(BM_SinCosLanes)->Arg(0)->Arg(BlockSize);
+
+//----------------------------------------------------------
+// Graph optimizations on a deep graph of 1000 nodes.
+
+void BM_DeepGraphFused(benchmark::State &state)
+{
+    df::Graph g;
+    deepGraph(g, 1000);
+    g.fusion(true);
+    run(state, g, frames(state));
+}
+
+BENCHMARK(BM_DeepGraphFused)->Arg(0)->Arg(BlockSize);
+
+//----------------------------------------------------------
+// Generated code against the interpreter: frames, compiled.
+
+void compiledArguments(benchmark::internal::Benchmark *b)
+{
+    for (int compiled : { 0, 1 }) {
+        b->Args({ 0, compiled });
+        b->Args({ int(BlockSize), compiled });
+    }
+}
+
+void compile(benchmark::State &state, df::Graph &g)
+{
+    if (state.range(1) == 0)
+        return;
+
+    auto *pJit = new df::JitExecutor();
+    g.executor(std::unique_ptr<df::Executor>(pJit));
+    g.blockSize(frames(state));
+
+    if (!pJit->compile(g))
+        state.SkipWithError("The graph could not be compiled");
+}
+
+void BM_DeepGraphCompiled(benchmark::State &state)
+{
+    df::Graph g;
+    deepGraph(g, 1000);
+    compile(state, g);
+    run(state, g, frames(state));
+}
+
+void BM_SinCosCompiled(benchmark::State &state)
+{
+    df::Graph g;
+    sinCosGraph(g);
+    compile(state, g);
+    run(state, g, frames(state));
+}
+
+BENCHMARK(BM_DeepGraphCompiled)->Apply(compiledArguments)->ArgNames({ "frames", "compiled" });
+BENCHMARK(BM_SinCosCompiled)->Apply(compiledArguments)->ArgNames({ "frames", "compiled" });
+
+BENCHMARK_MAIN();
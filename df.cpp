@@ -15,11 +15,956 @@
     Lesser General Public License for more details.
 */
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <queue>
+#include <unordered_map>
 #include "df.h"
 
 namespace df {
 
-double Node::timeStep() const { return m_graph.timeStep(); }
-double Node::sampleRate() const { return m_graph.sampleRate(); }
+void Port::topologyChanged()
+{
+    if (m_pNode != nullptr)
+        m_pNode->graph().invalidate();
+}
+
+void Port::valueChanged()
+{
+    if (m_pNode != nullptr)
+        m_pNode->graph().markDirty(*m_pNode);
+}
+
+double Node::timeStep() const { return m_graph.timeStep() * double(m_rateDivisor); }
+double Node::sampleRate() const { return m_graph.sampleRate() / double(m_rateDivisor); }
+void Node::invalidateGraph() { m_graph.invalidate(); }
+void Node::markDirty() { m_graph.markDirty(*this); }
+
+CommandQueue::CommandQueue(std::size_t capacity)
+    : m_slots(),
+      m_mask(0),
+      m_head(0),
+      m_tail(0)
+{
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_mask = size - 1;
+    m_slots.reset(new Slot[size]);
+
+    // Each slot sequence tells which push or pop
+    // (position) can use it next.
+    for (std::size_t i = 0; i < size; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool CommandQueue::push(const Command &command)
+{
+    std::size_t position = m_head.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Slot &slot = m_slots[position & m_mask];
+        const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const std::intptr_t difference = std::intptr_t(sequence) - std::intptr_t(position);
+
+        if (difference == 0) {
+            if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.command = command;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool CommandQueue::pop(Command &command)
+{
+    const std::size_t position = m_tail.load(std::memory_order_relaxed);
+    Slot &slot = m_slots[position & m_mask];
+
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+        return false;
+
+    command = slot.command;
+    slot.sequence.store(position + m_mask + 1, std::memory_order_release);
+    m_tail.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+//----------------------------------------------------------
+
+Graph::~Graph()
+{
+    // Nodes live in the arena, destroy them in the reverse creation order
+    for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it)
+        (*it)->~Node();
+}
+
+void Graph::registerNode(Node *pNode)
+{
+    pNode->m_index = m_nodes.size();
+    m_nodes.push_back(pNode);
+    invalidate();
+}
+
+Node* Graph::sourceNode(const InputPort *input) const
+{
+    if (input->source() == nullptr)
+        return nullptr;
+
+    Node *pNode = input->source()->node();
+    if (pNode == nullptr || &pNode->graph() != this)
+        return nullptr;
+
+    return pNode;
+}
+
+void Graph::prepare()
+{
+    const std::size_t count = m_nodes.size();
+
+    // Nodes whose outputs do not depend on the current block inputs
+    m_decoupledLatency = std::size_t(-1);
+    for (auto *n : m_nodes) {
+        n->m_consume = Node::Consume::Never;
+        if (n->m_rateDivisor == 1 && n->latency() >= std::max<std::size_t>(m_blockSize, 1)) {
+            n->m_consume = Node::Consume::AfterBlock;
+            m_decoupledLatency = std::min(m_decoupledLatency, n->latency());
+        }
+    }
+
+    std::vector<std::vector<std::size_t> > successors(count);
+    for (auto *n : m_nodes) {
+        if (n->m_consume == Node::Consume::AfterBlock)
+            continue;
+
+        for (const auto *input : n->m_inputs) {
+            if (Node *pSource = sourceNode(input))
+                successors[pSource->m_index].push_back(n->m_index);
+        }
+    }
+
+    // Find strongly connected components (feedback loops) with
+    // Tarjan's algorithm, iteratively to handle deep graphs.
+    constexpr std::size_t Unvisited = std::size_t(-1);
+    std::vector<std::size_t> visitIndex(count, Unvisited);
+    std::vector<std::size_t> lowLink(count, 0);
+    std::vector<std::size_t> component(count, Unvisited);
+    std::vector<bool> onStack(count, false);
+    std::vector<std::size_t> stack;
+    std::vector<std::pair<std::size_t, std::size_t> > callStack;
+    std::size_t nextIndex = 0;
+    std::size_t componentCount = 0;
+
+    for (std::size_t root = 0; root < count; ++root) {
+        if (visitIndex[root] != Unvisited)
+            continue;
+
+        callStack.emplace_back(root, 0);
+        while (!callStack.empty()) {
+            const std::size_t v = callStack.back().first;
+            std::size_t &edge = callStack.back().second;
+
+            if (edge == 0 && visitIndex[v] == Unvisited) {
+                visitIndex[v] = lowLink[v] = nextIndex++;
+                stack.push_back(v);
+                onStack[v] = true;
+            }
+
+            if (edge < successors[v].size()) {
+                const std::size_t w = successors[v][edge++];
+                if (visitIndex[w] == Unvisited)
+                    callStack.emplace_back(w, 0);
+                else if (onStack[w])
+                    lowLink[v] = std::min(lowLink[v], visitIndex[w]);
+                continue;
+            }
+
+            if (lowLink[v] == visitIndex[v]) {
+                std::size_t w;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = false;
+                    component[w] = componentCount;
+                } while (w != v);
+                ++componentCount;
+            }
+
+            callStack.pop_back();
+            if (!callStack.empty()) {
+                const std::size_t u = callStack.back().first;
+                lowLink[u] = std::min(lowLink[u], lowLink[v]);
+            }
+        }
+    }
+
+    // Nodes of each component, in creation order.
+    std::vector<std::vector<std::size_t> > members(componentCount);
+    for (std::size_t i = 0; i < count; ++i)
+        members[component[i]].push_back(i);
+
+    // Within a loop, delays are evaluated before the nodes they depend on,
+    // so that their inputs close the loop rather than adding a frame of delay
+    // elsewhere. Loops not going through a delay keep the creation order.
+    const auto delays = [this](std::size_t v) {
+        return m_nodes[v]->latency() > 0 && m_nodes[v]->m_rateDivisor == 1;
+    };
+
+    std::vector<std::size_t> predecessors(count, 0);
+    for (auto &list : members) {
+        if (list.size() < 2 || std::none_of(list.begin(), list.end(), delays))
+            continue;
+
+        for (std::size_t v : list) {
+            for (std::size_t w : successors[v]) {
+                if (component[w] == component[v] && !delays(w))
+                    ++predecessors[w];
+            }
+        }
+
+        std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<std::size_t> > next;
+        for (std::size_t v : list) {
+            if (predecessors[v] == 0)
+                next.push(v);
+        }
+
+        std::vector<std::size_t> sorted;
+        sorted.reserve(list.size());
+        while (!next.empty()) {
+            const std::size_t v = next.top();
+            next.pop();
+            sorted.push_back(v);
+
+            for (std::size_t w : successors[v]) {
+                if (component[w] == component[v] && !delays(w) && --predecessors[w] == 0)
+                    next.push(w);
+            }
+        }
+
+        for (std::size_t v : list) {
+            if (predecessors[v] > 0)
+                sorted.push_back(v);
+        }
+
+        list.swap(sorted);
+    }
+
+    // Sort the components topologically, preferring the ones
+    // created earlier when there is a choice.
+    std::vector<std::size_t> pending(componentCount, 0);
+    for (std::size_t v = 0; v < count; ++v) {
+        for (std::size_t w : successors[v]) {
+            if (component[v] != component[w])
+                ++pending[component[w]];
+        }
+    }
+
+    using Entry = std::pair<std::size_t, std::size_t>; // first node, component
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > ready;
+    for (std::size_t c = 0; c < componentCount; ++c) {
+        if (pending[c] == 0)
+            ready.emplace(members[c].front(), c);
+    }
+
+    m_order.clear();
+    m_order.reserve(count);
+    m_groups.clear();
+
+    while (!ready.empty()) {
+        const std::size_t c = ready.top().second;
+        ready.pop();
+
+        Group group { m_order.size(), m_order.size() + members[c].size(), members[c].size() > 1, {}, 0 };
+
+        for (std::size_t v : members[c]) {
+            m_order.push_back(m_nodes[v]);
+            for (std::size_t w : successors[v]) {
+                if (component[w] != c && --pending[component[w]] == 0)
+                    ready.emplace(members[component[w]].front(), component[w]);
+                else if (w == v)
+                    group.feedback = true;
+            }
+        }
+
+        if (group.feedback) {
+            for (std::size_t v : members[c]) {
+                if (delays(v))
+                    m_nodes[v]->m_consume = Node::Consume::AfterFrame;
+            }
+        }
+
+        m_groups.push_back(group);
+    }
+
+    // Inputs within a loop connected to a node that is evaluated
+    // later (or to the node itself) read the previous tick value.
+    std::vector<std::size_t> position(count, 0);
+    for (std::size_t k = 0; k < m_order.size(); ++k)
+        position[m_order[k]->m_index] = k;
+
+    for (auto *n : m_nodes) {
+        for (auto *input : n->m_inputs) {
+            Node *pSource = sourceNode(input);
+            input->m_feedback = pSource != nullptr && !n->decoupled()
+                && component[pSource->m_index] == component[n->m_index]
+                && position[pSource->m_index] >= position[n->m_index];
+        }
+    }
+
+    simplify();
+
+    m_fusedNodes.clear();
+    if (m_fusion)
+        fuse();
+
+    m_decoupledNodes.clear();
+    m_loopDecoupledNodes.clear();
+    for (auto *n : m_order) {
+        if (n->m_consume == Node::Consume::AfterBlock)
+            m_decoupledNodes.push_back(n);
+        else if (n->m_consume == Node::Consume::AfterFrame)
+            m_loopDecoupledNodes.push_back(n);
+    }
+
+    connectGroups();
+    trackChanges();
+
+#if DF_PROFILING
+    m_stats.attach(m_nodes);
+#endif
+
+    m_prepared = true;
+    ++m_revision;
+    reserve();
+}
+
+void Graph::simplify()
+{
+    const std::size_t count = m_nodes.size();
+
+    // Nodes the sinks depend on
+    std::vector<bool> live(count, !m_pruning);
+    if (m_pruning) {
+        std::vector<Node*> stack;
+        for (auto *n : m_nodes) {
+            const bool observed = std::any_of(n->m_outputs.begin(), n->m_outputs.end(),
+                                              [](const OutputPort *port) { return port->observed(); });
+            if (observed || n->m_outputs.empty()) {
+                live[n->m_index] = true;
+                stack.push_back(n);
+            }
+        }
+
+        while (!stack.empty()) {
+            Node *pNode = stack.back();
+            stack.pop_back();
+
+            for (const auto *input : pNode->m_inputs) {
+                Node *pSource = sourceNode(input);
+                if (pSource != nullptr && !live[pSource->m_index]) {
+                    live[pSource->m_index] = true;
+                    stack.push_back(pSource);
+                }
+            }
+        }
+    }
+
+    // Nodes depending only on constants, the sources being
+    // visited first. Unconnected inputs may change any time.
+    std::vector<bool> folded(count, false);
+    m_constantNodes.clear();
+
+    for (const auto &group : m_groups) {
+        Node *pNode = m_order[group.begin];
+        if (group.feedback || !live[pNode->m_index])
+            continue;
+
+        bool constant = pNode->constant();
+        if (!constant && pNode->pure()) {
+            constant = std::all_of(pNode->m_inputs.begin(), pNode->m_inputs.end(),
+                                   [this, &folded](const InputPort *input) {
+                                       const Node *pSource = sourceNode(input);
+                                       return pSource != nullptr && folded[pSource->m_index];
+                                   });
+        }
+
+        if (constant) {
+            folded[pNode->m_index] = true;
+            m_constantNodes.push_back(pNode);
+        }
+    }
+
+    for (auto *n : m_nodes)
+        n->m_folded = folded[n->m_index];
+
+    std::vector<Node*> order;
+    std::vector<Group> groups;
+
+    for (const auto &group : m_groups) {
+        const Node *pNode = m_order[group.begin];
+        if (folded[pNode->m_index] || !live[pNode->m_index])
+            continue;
+
+        groups.push_back(Group { order.size(), order.size() + group.end - group.begin, group.feedback, {}, 0 });
+        order.insert(order.end(), m_order.begin() + group.begin, m_order.begin() + group.end);
+    }
+
+    m_order.swap(order);
+    m_groups.swap(groups);
+}
+
+void Graph::fuse()
+{
+    const std::size_t count = m_nodes.size();
+
+    // Only the nodes evaluated on their own can be fused,
+    // nodes forming loops are evaluated frame by frame.
+    std::vector<bool> single(count, false);
+    for (const auto &group : m_groups) {
+        if (!group.feedback)
+            single[m_order[group.begin]->m_index] = true;
+    }
+
+    auto fusable = [&single](Node *pNode) -> Fusable* {
+        if (!single[pNode->m_index] || pNode->m_rateDivisor != 1)
+            return nullptr;
+        return dynamic_cast<Fusable*>(pNode);
+    };
+
+    // Count the inputs connected to each output
+    std::unordered_map<const OutputPort*, std::pair<std::size_t, Node*> > consumers;
+    for (auto *n : m_order) {
+        for (const auto *input : n->m_inputs) {
+            if (input->source() != nullptr) {
+                auto &consumer = consumers[input->source()];
+                ++consumer.first;
+                consumer.second = n;
+            }
+        }
+    }
+
+    // Nodes computed in place by the node they are connected to
+    std::vector<bool> internal(count, false);
+    for (auto *n : m_nodes) {
+        Fusable *pFusable = fusable(n);
+        if (pFusable == nullptr || n->m_outputs.size() != 1 || n->m_outputs.front()->observed())
+            continue;
+
+        const auto it = consumers.find(n->m_outputs.front());
+        if (it == consumers.end() || it->second.first != 1 || it->second.second == n)
+            continue;
+
+        Fusable *pConsumer = fusable(it->second.second);
+        internal[n->m_index] = pConsumer != nullptr && pFusable->fusableWith(*pConsumer);
+    }
+
+    auto isInternal = [this, &internal](const Node *pNode) {
+        return &pNode->graph() == this && internal[pNode->m_index];
+    };
+
+    auto hasInternalSource = [this, &isInternal](const Node *pNode) {
+        for (const auto *input : pNode->m_inputs) {
+            const Node *pSource = sourceNode(input);
+            if (pSource != nullptr && isInternal(pSource))
+                return true;
+        }
+        return false;
+    };
+
+    // Drop the internal nodes, and replace the expressions
+    // results nodes by the fused ones.
+    std::vector<Node*> order;
+    std::vector<Group> groups;
+
+    for (const auto &group : m_groups) {
+        Node *pNode = m_order[group.begin];
+
+        if (!group.feedback) {
+            if (isInternal(pNode))
+                continue;
+
+            if (hasInternalSource(pNode)) {
+                m_fusedNodes.push_back(fusable(pNode)->fuse(isInternal));
+                m_fusedNodes.back()->m_index = pNode->m_index;
+                pNode = m_fusedNodes.back().get();
+            }
+        }
+
+        groups.push_back(Group { order.size(), order.size() + group.end - group.begin, group.feedback, {}, 0 });
+
+        if (group.feedback)
+            order.insert(order.end(), m_order.begin() + group.begin, m_order.begin() + group.end);
+        else
+            order.push_back(pNode);
+    }
+
+    m_order.swap(order);
+    m_groups.swap(groups);
+}
+
+void Graph::connectGroups()
+{
+    constexpr std::size_t Unscheduled = std::size_t(-1);
+    std::vector<std::size_t> groupOf(m_nodes.size(), Unscheduled);
+    for (std::size_t i = 0; i < m_groups.size(); ++i) {
+        for (std::size_t k = m_groups[i].begin; k < m_groups[i].end; ++k)
+            groupOf[m_order[k]->m_index] = i;
+    }
+
+    for (std::size_t to = 0; to < m_groups.size(); ++to) {
+        for (std::size_t k = m_groups[to].begin; k < m_groups[to].end; ++k) {
+            if (m_order[k]->m_consume == Node::Consume::AfterBlock)
+                continue;
+
+            for (const auto *input : m_order[k]->m_inputs) {
+                const Node *pSource = sourceNode(input);
+                if (pSource == nullptr || groupOf[pSource->m_index] == Unscheduled)
+                    continue;
+
+                // Groups are visited in order, a repeated successor can only be the last one
+                const std::size_t from = groupOf[pSource->m_index];
+                auto &list = m_groups[from].successors;
+                if (from != to && (list.empty() || list.back() != to)) {
+                    list.push_back(to);
+                    ++m_groups[to].dependencies;
+                }
+            }
+        }
+    }
+}
+
+void Graph::trackChanges()
+{
+    m_positions.clear();
+    m_dependents.clear();
+    m_alwaysDirty.clear();
+    m_dirty.clear();
+    m_pending.clear();
+
+    if (!m_incremental)
+        return;
+
+    constexpr std::size_t Unscheduled = std::size_t(-1);
+    const std::size_t count = m_order.size();
+    m_positions.assign(m_nodes.size(), Unscheduled);
+
+    for (std::size_t k = 0; k < count; ++k)
+        m_positions[m_order[k]->m_index] = k;
+
+    // Inputs of the fused nodes belong to the nodes they replace
+    for (std::size_t k = 0; k < count; ++k) {
+        for (const auto *input : m_order[k]->m_inputs) {
+            const Node *pOwner = input->node();
+            if (pOwner != nullptr && m_positions[pOwner->m_index] == Unscheduled)
+                m_positions[pOwner->m_index] = k;
+        }
+    }
+
+    m_dependents.resize(count);
+    for (std::size_t k = 0; k < count; ++k) {
+        for (const auto *input : m_order[k]->m_inputs) {
+            const Node *pSource = sourceNode(input);
+            if (pSource == nullptr || m_positions[pSource->m_index] == Unscheduled)
+                continue;
+
+            // Feedback connections are covered by the loops being always dirty
+            const std::size_t from = m_positions[pSource->m_index];
+            auto &list = m_dependents[from];
+            if (from < k && std::find(list.begin(), list.end(), k) == list.end())
+                list.push_back(k);
+        }
+    }
+
+    for (const auto &group : m_groups) {
+        for (std::size_t k = group.begin; k < group.end; ++k) {
+            if (group.feedback || m_order[k]->alwaysDirty())
+                m_alwaysDirty.push_back(k);
+        }
+    }
+
+    // Everything gets evaluated on the first tick,
+    // positions in order already form a heap.
+    m_dirty.assign(count, true);
+    m_pending.resize(count);
+    for (std::size_t k = 0; k < count; ++k)
+        m_pending[k] = k;
+}
+
+void Graph::evaluateDirty()
+{
+    for (std::size_t k : m_alwaysDirty) {
+        if (due(m_order[k], 0))
+            markDirty(k);
+    }
+
+    while (!m_pending.empty()) {
+        std::pop_heap(m_pending.begin(), m_pending.end(), std::greater<std::size_t>());
+        const std::size_t k = m_pending.back();
+        m_pending.pop_back();
+        m_dirty[k] = false;
+
+        evaluateNode(m_order[k]);
+
+        for (std::size_t next : m_dependents[k])
+            markDirty(next);
+    }
+}
+
+void Graph::blockSize(std::size_t frames)
+{
+    m_blockSize = frames;
+
+    // Decoupled nodes must lag behind by a whole block
+    if (frames > m_decoupledLatency)
+        invalidate();
+
+    reserve();
+}
+
+void Graph::snapshot(std::vector<char> &data) const
+{
+    using Size = std::uint32_t;
+
+    std::size_t size = sizeof(m_frame);
+    for (const auto *n : m_nodes) {
+        size += sizeof(Size) + n->stateSize();
+        for (const auto *port : n->m_inputs)
+            size += port->valueSize();
+        for (const auto *port : n->m_outputs)
+            size += port->valueSize();
+    }
+
+    data.resize(size);
+    char *p = data.data();
+
+    std::memcpy(p, &m_frame, sizeof(m_frame));
+    p += sizeof(m_frame);
+
+    for (const auto *n : m_nodes) {
+        const Size stateSize = Size(n->stateSize());
+        std::memcpy(p, &stateSize, sizeof(stateSize));
+        p += sizeof(stateSize);
+        n->saveState(p);
+        p += stateSize;
+
+        for (const auto *port : n->m_inputs) {
+            port->saveValue(p);
+            p += port->valueSize();
+        }
+        for (const auto *port : n->m_outputs) {
+            port->saveValue(p);
+            p += port->valueSize();
+        }
+    }
+}
+
+bool Graph::restore(const void *pData, std::size_t size)
+{
+    using Size = std::uint32_t;
+
+    const char *pBegin = static_cast<const char*>(pData);
+    const char *pEnd = pBegin + size;
+
+    if (size < sizeof(m_frame))
+        return false;
+
+    // Check the layout first, not to restore the graph in part
+    const char *p = pBegin + sizeof(m_frame);
+
+    for (const auto *n : m_nodes) {
+        Size stateSize = 0;
+        if (std::size_t(pEnd - p) < sizeof(stateSize))
+            return false;
+        std::memcpy(&stateSize, p, sizeof(stateSize));
+        p += sizeof(stateSize);
+
+        std::size_t valuesSize = 0;
+        for (const auto *port : n->m_inputs)
+            valuesSize += port->valueSize();
+        for (const auto *port : n->m_outputs)
+            valuesSize += port->valueSize();
+
+        if (std::size_t(pEnd - p) < stateSize || std::size_t(pEnd - p) - stateSize < valuesSize)
+            return false;
+        p += stateSize + valuesSize;
+    }
+
+    if (p != pEnd)
+        return false;
+
+    std::memcpy(&m_frame, pBegin, sizeof(m_frame));
+    p = pBegin + sizeof(m_frame);
+
+    for (auto *n : m_nodes) {
+        Size stateSize = 0;
+        std::memcpy(&stateSize, p, sizeof(stateSize));
+        p += sizeof(stateSize);
+
+        if (!n->loadState(p, stateSize))
+            return false;
+        p += stateSize;
+
+        for (auto *port : n->m_inputs) {
+            port->loadValue(p);
+            p += port->valueSize();
+        }
+        for (auto *port : n->m_outputs) {
+            port->loadValue(p);
+            p += port->valueSize();
+        }
+
+        markDirty(*n);
+    }
+
+    return true;
+}
+
+void Graph::reserve()
+{
+    for (auto *n : m_nodes)
+        n->reserve(m_blockSize);
+
+    if (m_blockSize > 0) {
+        share();
+
+        for (auto *n : m_nodes) {
+            for (auto *port : n->m_inputs)
+                port->reserve(m_blockSize);
+            for (auto *port : n->m_outputs)
+                port->reserve(m_blockSize);
+        }
+    }
+
+    m_storageSize = m_sharedStorage.size();
+    for (auto *n : m_nodes) {
+        for (const auto *port : n->m_outputs)
+            m_storageSize += port->storageSize();
+    }
+
+    // Constant outputs hold the same value in all the frames
+    for (auto *n : m_constantNodes) {
+        if (m_blockSize == 0) {
+            n->evaluate();
+        } else {
+            n->process(m_blockSize);
+            n->rewind(m_blockSize);
+        }
+    }
+}
+
+void Graph::share()
+{
+    for (auto *n : m_nodes) {
+        for (auto *port : n->m_outputs)
+            port->share(nullptr);
+    }
+
+    m_sharedStorage.clear();
+    if (!m_sharing || !m_prepared || m_pExecutor)
+        return;
+
+    // Groups each block is needed from and until, in the evaluation order.
+    // Inputs read by consume() are read once all the groups are evaluated.
+    struct Lifetime
+    {
+        OutputPort *pPort;
+        std::size_t begin;
+        std::size_t end;
+        std::size_t size;
+        std::size_t offset;
+    };
+
+    std::vector<Lifetime> lifetimes;
+    std::unordered_map<const OutputPort*, std::size_t> lifetimeOf;
+
+    for (std::size_t g = 0; g < m_groups.size(); ++g) {
+        for (std::size_t k = m_groups[g].begin; k < m_groups[g].end; ++k) {
+            for (auto *port : m_order[k]->m_outputs) {
+                if (port->valueSize() > 0 && !port->observed()) {
+                    lifetimeOf[port] = lifetimes.size();
+                    lifetimes.push_back(Lifetime { port, g, g, 0, 0 });
+                }
+            }
+        }
+    }
+
+    for (std::size_t g = 0; g < m_groups.size(); ++g) {
+        for (std::size_t k = m_groups[g].begin; k < m_groups[g].end; ++k) {
+            const Node *pNode = m_order[k];
+            const std::size_t end = pNode->m_consume == Node::Consume::AfterBlock ? m_groups.size() : g;
+
+            for (const auto *input : pNode->m_inputs) {
+                const auto it = lifetimeOf.find(input->source());
+                if (it != lifetimeOf.end())
+                    lifetimes[it->second].end = std::max(lifetimes[it->second].end, end);
+            }
+        }
+    }
+
+    // Assign the blocks in order, reusing the best fitting free one.
+    // Blocks are aligned on cache lines.
+    constexpr std::size_t Alignment = 64;
+    std::multimap<std::size_t, std::size_t> free;
+    std::vector<std::size_t> live;
+    std::size_t total = 0;
+
+    for (std::size_t i = 0; i < lifetimes.size(); ++i) {
+        auto &lifetime = lifetimes[i];
+
+        for (std::size_t j = 0; j < live.size();) {
+            const auto &other = lifetimes[live[j]];
+            if (other.end < lifetime.begin) {
+                free.emplace(other.size, other.offset);
+                live[j] = live.back();
+                live.pop_back();
+            } else {
+                ++j;
+            }
+        }
+
+        const std::size_t size = (lifetime.pPort->valueSize() * m_blockSize + Alignment - 1) / Alignment * Alignment;
+        const auto it = free.lower_bound(size);
+
+        if (it != free.end()) {
+            lifetime.size = it->first;
+            lifetime.offset = it->second;
+            free.erase(it);
+        } else {
+            lifetime.size = size;
+            lifetime.offset = total;
+            total += size;
+        }
+
+        live.push_back(i);
+    }
+
+    m_sharedStorage.resize(total + Alignment);
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(m_sharedStorage.data());
+    char *pBase = m_sharedStorage.data() + (Alignment - address % Alignment) % Alignment;
+
+    for (const auto &lifetime : lifetimes)
+        lifetime.pPort->share(pBase + lifetime.offset);
+}
+
+void Graph::applyCommands(std::size_t frames)
+{
+    // Commands deferred by the previous evaluations go first
+    std::size_t kept = 0;
+    for (auto &command : m_deferred) {
+        if (command.frame >= frames) {
+            command.frame -= frames;
+            m_deferred[kept++] = command;
+        } else {
+            command.apply(command.pTarget, &command.value, command.frame);
+        }
+    }
+    m_deferred.resize(kept);
+
+    CommandQueue::Command command;
+    while (m_pCommands->pop(command)) {
+        if (command.frame >= frames) {
+            if (m_deferred.size() < m_deferred.capacity()) {
+                command.frame -= frames;
+                m_deferred.push_back(command);
+                continue;
+            }
+
+            // No room left, apply as late as possible
+            command.frame = frames - 1;
+        }
+
+        command.apply(command.pTarget, &command.value, command.frame);
+    }
+}
+
+void Graph::evaluate(std::size_t frames)
+{
+    if (frames == 0)
+        return;
+
+    applyCommands(frames);
+
+    if (frames > m_blockSize)
+        blockSize(frames);
+
+    if (!m_prepared)
+        prepare();
+
+    if (m_pMonitor == nullptr) {
+        evaluateBlock(frames);
+    } else {
+        const auto start = std::chrono::steady_clock::now();
+        evaluateBlock(frames);
+        m_pMonitor->evaluated(*this, frames, std::chrono::steady_clock::now() - start);
+    }
+
+    m_frame += frames;
+}
+
+void Graph::evaluateBlock(std::size_t frames)
+{
+#if DF_PROFILING
+    Stats::Scope scope(m_stats, frames);
+#endif
+
+    if (m_pExecutor) {
+        m_pExecutor->evaluate(*this, frames);
+    } else {
+        for (std::size_t i = 0; i < m_groups.size(); ++i)
+            evaluateGroup(i, frames);
+    }
+
+    for (auto *n : m_decoupledNodes)
+        n->consume(frames);
+}
+
+void Graph::evaluateGroup(std::size_t index, std::size_t frames)
+{
+    const Group &group = m_groups[index];
+
+    if (frames == 0) {
+        for (std::size_t k = group.begin; k < group.end; ++k) {
+            if (due(m_order[k], 0))
+                evaluateNode(m_order[k]);
+        }
+        return;
+    }
+
+    for (std::size_t k = group.begin; k < group.end; ++k)
+        m_order[k]->fill(frames);
+
+    if (!group.feedback) {
+        Node *pNode = m_order[group.begin];
+        processNode(pNode, frames);
+        pNode->rewind(frames);
+        return;
+    }
+
+    // Feedback loops are evaluated frame by frame
+    for (std::size_t i = 0; i < frames; ++i) {
+        for (std::size_t k = group.begin; k < group.end; ++k) {
+            if (due(m_order[k], i))
+                evaluateNodeFrame(m_order[k], i);
+            else
+                m_order[k]->seek(i);
+        }
+
+        for (std::size_t k = group.begin; k < group.end; ++k) {
+            if (m_order[k]->m_consume == Node::Consume::AfterFrame)
+                m_order[k]->consume(0);
+        }
+    }
+
+    for (std::size_t k = group.begin; k < group.end; ++k)
+        m_order[k]->rewind(frames);
+}
 
 } // namespace df
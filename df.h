@@ -18,72 +18,416 @@
 #ifndef DF_H_INCLUDED
 #define DF_H_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <random>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <utility>
+#include "df_random.h"
+#include "df_simd.h"
+
+// Per-node timing statistics and trace events, see df_profile.h
+#ifndef DF_PROFILING
+#   define DF_PROFILING 0
+#endif
+
+#if DF_PROFILING
+#   include "df_profile.h"
+#endif
 
 namespace df {
 
+// Forward declarations
+class Node;
+class Graph;
+
+template <typename T>
+class Output;
+
+template <typename T>
+class InputArray;
+
+template <class... Ns>
+class StaticGraph;
+
+/**
+ * @brief Raw copies of values, as used to save and restore the graph state.
+ * Only values of trivially copyable types get copied, other types have
+ * a zero size.
+ */
+namespace raw {
+
+template <typename... Ts>
+struct Copyable : std::true_type {};
+
+template <typename T, typename... Ts>
+struct Copyable<T, Ts...> : std::integral_constant<bool, std::is_trivially_copyable<T>::value
+                                                         && Copyable<Ts...>::value> {};
+
+template <typename... Ts>
+constexpr std::size_t sizeOf() { return 0; }
+
+template <typename T, typename... Ts>
+constexpr std::size_t sizeOf(const T*, const Ts*... others) { return sizeof(T) + sizeOf(others...); }
+
+/// Bytes taken by the values of the given types, zero unless they are all trivially copyable.
+template <typename... Ts>
+constexpr std::size_t size() { return Copyable<Ts...>::value ? sizeOf(static_cast<const Ts*>(nullptr)...) : 0; }
+
+inline void copyOut(char*) {}
+
+template <typename T, typename... Ts>
+void copyOut(char *pData, const T &value, const Ts&... values)
+{
+    std::memcpy(pData, &value, sizeof(T));
+    copyOut(pData + sizeof(T), values...);
+}
+
+inline void copyIn(const char*) {}
+
+template <typename T, typename... Ts>
+void copyIn(const char *pData, T &value, Ts&... values)
+{
+    std::memcpy(&value, pData, sizeof(T));
+    copyIn(pData + sizeof(T), values...);
+}
+
+template <typename... Ts>
+void save(std::true_type, void *pData, const Ts&... values) { copyOut(static_cast<char*>(pData), values...); }
+
+template <typename... Ts>
+void save(std::false_type, void*, const Ts&...) {}
+
+template <typename... Ts>
+void load(std::true_type, const void *pData, Ts&... values) { copyIn(static_cast<const char*>(pData), values...); }
+
+template <typename... Ts>
+void load(std::false_type, const void*, Ts&...) {}
+
+/// Write the values one after another, size<Ts...>() bytes in total.
+template <typename... Ts>
+void save(void *pData, const Ts&... values) { save(Copyable<Ts...>(), pData, values...); }
+
+/// Read the values written by save().
+template <typename... Ts>
+void load(const void *pData, Ts&... values) { load(Copyable<Ts...>(), pData, values...); }
+
+} // namespace raw
+
+/**
+ * @brief Base class for all ports.
+ * Keeps a reference to the node the port belongs to.
+ */
+class Port
+{
+public:
+
+    Port()
+        : m_pNode(nullptr)
+    {
+    }
+
+    virtual ~Port() {}
+
+    Node* node() const { return m_pNode; }
+
+    /// Allocate the storage required to process blocks of given size.
+    virtual void reserve(std::size_t frames) = 0;
+
+    /// Point the port to the given frame of the current block.
+    virtual void seek(std::size_t frame) = 0;
+
+    /// Complete the block processing, the port gets back
+    /// to holding a single (the latest) value.
+    virtual void rewind(std::size_t frames) = 0;
+
+    /// Size of the raw value, zero if it cannot be copied as is.
+    virtual std::size_t valueSize() const = 0;
+
+    /// Copy the raw value (the default value of an input) to or from memory.
+    virtual void saveValue(void *pData) const = 0;
+    virtual void loadValue(const void *pData) = 0;
+
+protected:
+
+    // Notify the owning graph that connections have changed.
+    void topologyChanged();
+
+    // Notify the owning graph that the node must be evaluated again.
+    void valueChanged();
+
+private:
+
+    friend class df::Graph;
+    friend class df::Node;
+
+    Node *m_pNode;
+};
+
+class OutputPort : public Port
+{
+public:
+
+    OutputPort()
+        : m_observed(false)
+    {
+    }
+
+    /**
+     * @brief Mark the output as read from outside the graph.
+     * Graph optimizations keep observed outputs up to date.
+     */
+    void observe(bool observed = true)
+    {
+        m_observed = observed;
+        topologyChanged();
+    }
+
+    bool observed() const { return m_observed; }
+
+    /// Take the value of another output of the same type.
+    virtual void copyValue(const OutputPort &other) = 0;
+
+    /// Repeat the value preceding the given frames of the current block.
+    virtual void hold(std::size_t begin, std::size_t end) = 0;
+
+    /**
+     * @brief Store the blocks in memory shared with other outputs (see Graph::sharing()).
+     * The memory must hold a block of valueSize() bytes values, nullptr returns
+     * to the port own storage, which gets allocated again by reserve().
+     */
+    virtual void share(void *pBlock) = 0;
+
+    /// Bytes of block storage owned by the port.
+    virtual std::size_t storageSize() const = 0;
+
+private:
+
+    bool m_observed;
+};
+
+/**
+ * @brief Type-independent part of an input port.
+ * It records the output this input is connected to, so that
+ * the graph can figure out the dependencies between the nodes.
+ */
+class InputPort : public Port
+{
+public:
+
+    InputPort()
+        : m_pSource(nullptr),
+          m_feedback(false)
+    {
+    }
+
+    /// Output this input is connected to, or nullptr.
+    OutputPort* source() const { return m_pSource; }
+
+    /// Whether this input closes a feedback loop, so that it
+    /// reads the value its source had on the previous tick.
+    bool feedback() const { return m_feedback; }
+
+    /// Fill the block of an input which is not connected to an output.
+    virtual void fill(std::size_t frames) = 0;
+
+    /**
+     * @brief Connect to an output.
+     * @return false if the output value type differs.
+     */
+    virtual bool connect(OutputPort &source) = 0;
+
+protected:
+
+    OutputPort *m_pSource;
+
+private:
+
+    friend class df::Graph;
+    template <class... Ns> friend class df::StaticGraph;
+
+    bool m_feedback;
+};
+
 /**
  * @brief Input port.
  * Input can be either connected to an output, or to an internal default value.
+ *
+ * When processing blocks, block() gives access to all the frames
+ * of the current block.
  */
 template <typename T>
-class Input
+class Input : public InputPort
 {
 public:
 
+    friend class df::Output<T>;
+
     Input()
         : m_defaultValue(),
-          m_pConnectedValue(&m_defaultValue)
+          m_pValue(&m_defaultValue),
+          m_pConnectedValue(&m_defaultValue),
+          m_buffer()
     {
     }
 
     const T& value() const { return *m_pConnectedValue; }
     const T& operator()() const { return value(); }
 
-    void connect(T *pValue) { m_pConnectedValue = pValue; }
-    void disconnect() { m_pConnectedValue = &m_defaultValue; }
+    /// Frames of the current block.
+    const T* block() const;
+
+    void connect(T *pValue)
+    {
+        connect(nullptr, pValue);
+    }
+
+    void disconnect()
+    {
+        connect(nullptr, &m_defaultValue);
+    }
+
+    bool connect(OutputPort &source) override;
 
     Input<T>& operator =(const T& value)
     {
         *m_pConnectedValue = value;
+        valueChanged();
         return *this;
     }
 
+    void reserve(std::size_t frames) override
+    {
+        if (m_pSource == nullptr && m_buffer.size() < frames)
+            m_buffer.resize(frames);
+    }
+
+    void fill(std::size_t frames) override
+    {
+        std::fill(m_buffer.begin(), m_buffer.begin() + frames, *m_pValue);
+    }
+
+    void seek(std::size_t frame) override;
+
+    void rewind(std::size_t) override
+    {
+        m_pConnectedValue = m_pValue;
+    }
+
+    std::size_t valueSize() const override { return raw::size<T>(); }
+
+    void saveValue(void *pData) const override { raw::save(pData, m_defaultValue); }
+
+    void loadValue(const void *pData) override
+    {
+        raw::load(pData, m_defaultValue);
+        valueChanged();
+    }
+
 private:
 
     Input(const Input<T>&) = delete;
     Input<T>& operator =(const Input<T>&) = delete;
 
+    void connect(OutputPort *pSource, T *pValue)
+    {
+        m_pSource = pSource;
+        m_pValue = pValue;
+        m_pConnectedValue = pValue;
+        topologyChanged();
+    }
+
+    Output<T>& sourceOutput() const { return *static_cast<Output<T>*>(m_pSource); }
+
     T m_defaultValue;
+
+    // Value this input refers to between the blocks.
+    T* m_pValue;
+
+    // Currently referenced value.
     T* m_pConnectedValue;
+
+    // Block storage, when not connected to an output.
+    std::vector<T> m_buffer;
 };
 
 /**
  * @brief Output port.
- * Output port holds a value, which can be referenced by connected inputs
+ * Output port holds a value, which can be referenced by connected inputs.
+ *
+ * When processing blocks, the output holds a buffer of frames which
+ * is accessible via block(). Once the block is processed the value
+ * of the output is that of the last frame.
  */
 template <typename T>
-class Output
+class Output : public OutputPort
 {
 public:
 
+    friend class df::Input<T>;
+
     Output()
-        : m_value()
+        : m_value(),
+          m_pValue(&m_value),
+          m_buffer(),
+          m_pBlock(nullptr),
+          m_pShared(nullptr),
+          m_pExternal(nullptr),
+          m_readOnly(false)
     {
     }
 
-    const T& value() const { return m_value; }
+    const T& value() const { return *m_pValue; }
     const T& operator()() const { return value(); }
 
+    /// Frames of the current block.
+    T* block() { return m_pExternal != nullptr ? m_pExternal : m_pBlock; }
+    const T* block() const { return m_pExternal != nullptr ? m_pExternal : m_pBlock; }
+
+    /**
+     * @brief Store the frames of the blocks in external memory.
+     * The node then writes the block right there, and the connected inputs
+     * read it in place. The memory must hold the frames of all the blocks
+     * evaluated while bound, nullptr returns to the port own storage.
+     */
+    void bind(T *pBlock)
+    {
+        m_pExternal = pBlock;
+        m_readOnly = false;
+    }
+
+    /**
+     * @brief Have the connected inputs read the block from read-only memory.
+     * The binding lasts until the node writes the output (see seek(), hold()),
+     * which then goes back to the port own storage.
+     */
+    void view(const T *pBlock)
+    {
+        m_pExternal = const_cast<T*>(pBlock);
+        m_readOnly = pBlock != nullptr;
+    }
+
+    bool bound() const { return m_pExternal != nullptr; }
+
     void connect(Input<T> &input)
     {
-        input.connect(&m_value);
+        input.connect(this, &m_value);
     }
 
     Output<T>& operator =(const T& value)
     {
-        m_value = value;
+        writable(0);
+        *m_pValue = value;
         return *this;
     }
 
@@ -93,13 +437,124 @@ public:
         return *this;
     }
 
+    /// Connect to an input of another type, through a conversion node added to the graph.
+    template <typename U>
+    Output<T>& operator >>(Input<U> &input);
+
+    void reserve(std::size_t frames) override
+    {
+        if (m_pShared == nullptr && m_buffer.size() < frames)
+            m_buffer.resize(frames);
+
+        m_pBlock = m_pShared != nullptr ? m_pShared : m_buffer.data();
+    }
+
+    void seek(std::size_t frame) override
+    {
+        // Carry the previous frame over, so that a node reading
+        // its own output sees the value from the previous tick.
+        writable(frame);
+        T *pBlock = block();
+        pBlock[frame] = frame == 0 ? m_value : pBlock[frame - 1];
+        m_pValue = &pBlock[frame];
+    }
+
+    void rewind(std::size_t frames) override
+    {
+        m_value = block()[frames - 1];
+        m_pValue = &m_value;
+    }
+
+    void hold(std::size_t begin, std::size_t end) override
+    {
+        if (begin < end) {
+            writable(begin);
+            T *pBlock = block();
+            const T value = begin == 0 ? m_value : pBlock[begin - 1];
+            std::fill(pBlock + begin, pBlock + end, value);
+        }
+    }
+
+    void copyValue(const OutputPort &other) override
+    {
+        if (const auto *pOther = dynamic_cast<const Output<T>*>(&other))
+            m_value = pOther->m_value;
+    }
+
+    void share(void *pBlock) override
+    {
+        m_pShared = static_cast<T*>(pBlock);
+        if (m_pShared != nullptr)
+            std::vector<T>().swap(m_buffer);
+
+        m_pBlock = m_pShared != nullptr ? m_pShared : m_buffer.data();
+    }
+
+    std::size_t storageSize() const override { return m_buffer.size() * sizeof(T); }
+
+    std::size_t valueSize() const override { return raw::size<T>(); }
+    void saveValue(void *pData) const override { raw::save(pData, m_value); }
+    void loadValue(const void *pData) override { raw::load(pData, m_value); }
+
 private:
     Output(const Output<T>&) = delete;
     Output<T>& operator =(const Output<T>&) = delete;
 
+    // Leave the read-only memory before writing the block, keeping the frames preceding the given one.
+    void writable(std::size_t frame)
+    {
+        if (m_readOnly) {
+            std::copy(m_pExternal, m_pExternal + frame, m_pBlock);
+            m_pExternal = nullptr;
+            m_readOnly = false;
+        }
+    }
+
     T m_value;
+
+    // Currently referenced value.
+    T* m_pValue;
+
+    // Block storage, unless shared with other outputs.
+    std::vector<T> m_buffer;
+    T* m_pBlock;
+    T* m_pShared;
+
+    // Memory holding the blocks instead of the storage, that must not be written if read-only.
+    T* m_pExternal;
+    bool m_readOnly;
 };
 
+template <typename T>
+bool Input<T>::connect(OutputPort &source)
+{
+    auto *pOutput = dynamic_cast<Output<T>*>(&source);
+    if (pOutput == nullptr)
+        return false;
+
+    pOutput->connect(*this);
+    return true;
+}
+
+template <typename T>
+const T* Input<T>::block() const
+{
+    return m_pSource != nullptr ? sourceOutput().block() : m_buffer.data();
+}
+
+template <typename T>
+void Input<T>::seek(std::size_t frame)
+{
+    if (m_pSource == nullptr)
+        m_pConnectedValue = &m_buffer[frame];
+    else if (!feedback())
+        m_pConnectedValue = &sourceOutput().block()[frame];
+    else if (frame == 0)
+        m_pConnectedValue = &sourceOutput().m_value;
+    else
+        m_pConnectedValue = &sourceOutput().block()[frame - 1];
+}
+
 /**
  * @brief List of input ports
  */
@@ -111,6 +566,8 @@ class Inputs<>
 {
 public:
     Inputs() {}
+
+    void listInputs(std::vector<InputPort*>&) {}
 };
 
 template <typename T, typename... Ts>
@@ -146,6 +603,12 @@ public:
     Input<T>& firstInput() { return m_thisInput; }
     OtherInputs& otherInputs() { return *this; }
 
+    void listInputs(std::vector<InputPort*> &ports)
+    {
+        ports.push_back(&m_thisInput);
+        otherInputs().listInputs(ports);
+    }
+
 private:
 
     Input<T> m_thisInput;
@@ -162,6 +625,8 @@ class Outputs<>
 {
 public:
     Outputs() {}
+
+    void listOutputs(std::vector<OutputPort*>&) {}
 };
 
 template <typename T, typename... Ts>
@@ -198,14 +663,17 @@ public:
     Output<T>& firstOutput() { return m_thisOutput; }
     OtherOutputs& otherOutputs() { return *this; }
 
+    void listOutputs(std::vector<OutputPort*> &ports)
+    {
+        ports.push_back(&m_thisOutput);
+        otherOutputs().listOutputs(ports);
+    }
+
 private:
 
     Output<T> m_thisOutput;
 };
 
-// Forward declaration
-class Graph;
-
 /**
  * @brief Processing node.
  * A node cannot exist outside of a graph.
@@ -215,234 +683,2342 @@ class Node
 public:
 
     friend class df::Graph;
-    using Ptr = std::shared_ptr<Node>;
+    template <class... Ns> friend class df::StaticGraph;
+    template <typename T> friend class df::InputArray;
 
     Node(Graph &g)
-        : m_graph(g)
+        : m_graph(g),
+          m_index(0),
+          m_name(),
+          m_rateDivisor(1),
+          m_consume(Consume::Never),
+          m_folded(false)
     {}
 
     virtual ~Node() {}
 
+    /// Compute a single frame.
     virtual void evaluate() {}
 
+    /**
+     * @brief Compute a block of frames.
+     * Nodes capable of processing whole blocks override this method
+     * and work directly on inputs and outputs block() buffers.
+     * By default the block is processed frame by frame via evaluate().
+     */
+    virtual void process(std::size_t frames)
+    {
+        for (std::size_t i = 0; i < frames; ++i)
+            evaluateFrame(i);
+    }
+
+    /**
+     * @brief Whether the node outputs only depend on its current inputs.
+     * Pure nodes connected to constants only are evaluated once, when the graph
+     * gets prepared, instead of on each tick.
+     */
+    virtual bool pure() const { return false; }
+
+    /// Whether the node outputs never change.
+    virtual bool constant() const { return false; }
+
+    /**
+     * @brief Whether the node must be evaluated on each tick in incremental mode.
+     * This is the case of nodes having a state or depending on time.
+     * By default only pure nodes wait for their inputs to change.
+     */
+    virtual bool alwaysDirty() const { return !pure(); }
+
+    /**
+     * @brief Take over the internal state of the node this one replaces.
+     * Called when a graph replaces another one (see Engine), for nodes of the
+     * same type and name. Output values are transferred beforehand.
+     */
+    virtual void inheritState(const Node &previous) { (void)previous; }
+
+    /**
+     * @brief Size of the node state besides its ports values.
+     * saveState() writes that many bytes, that loadState() reads back,
+     * possibly into another instance of the same type.
+     */
+    virtual std::size_t stateSize() const { return 0; }
+    virtual void saveState(void *) const {}
+
+    /// @return false if the state size does not match.
+    virtual bool loadState(const void *, std::size_t size) { return size == 0; }
+
+    /**
+     * @brief Change the number of inputs, of the nodes taking any number.
+     * Called when loading a graph (see df_serialize.h), before loadState().
+     * @return false if the node inputs are fixed and their number differs.
+     */
+    virtual bool resizeInputs(std::size_t count) { return count == m_inputs.size(); }
+
+    /// Allocate the storage required to process blocks of given size.
+    virtual void reserve(std::size_t frames) { (void)frames; }
+
+    /**
+     * @brief Number of frames the outputs lag behind the inputs.
+     * When the latency is at least the block size, the outputs only depend on
+     * the inputs of previous blocks: the graph then orders the node as if its
+     * inputs were not connected, which breaks the feedback loops it is part of,
+     * and calls consume() once all the nodes have been evaluated. Within loops
+     * evaluated frame by frame, consume() gets called after each frame instead,
+     * so that the latency replaces the frame of delay the loop would add.
+     */
+    virtual std::size_t latency() const { return 0; }
+
+    /**
+     * @brief Read the inputs of the block just evaluated, see latency().
+     * Zero frames stands for a single tick, read from the inputs value().
+     */
+    virtual void consume(std::size_t frames) { (void)frames; }
+
+    /// Position of the node in the graph creation order.
+    std::size_t index() const { return m_index; }
+
+    /**
+     * @brief Evaluate the node once every given number of frames.
+     * This makes the node run at a lower (control) rate: its time step gets
+     * multiplied by the divisor. Between the evaluations the outputs hold
+     * their value, and the inputs are sampled when the node gets evaluated.
+     */
+    void rateDivisor(std::size_t divisor)
+    {
+        m_rateDivisor = divisor > 0 ? divisor : 1;
+        invalidateGraph();
+    }
+
+    std::size_t rateDivisor() const { return m_rateDivisor; }
+
+    /// Optional name, identifying the node across graphs.
+    const std::string& name() const { return m_name; }
+    void name(const std::string &n) { m_name = n; }
+
+    Graph& graph() const { return m_graph; }
+
+    const std::vector<InputPort*>& inputs() const { return m_inputs; }
+    const std::vector<OutputPort*>& outputs() const { return m_outputs; }
+
 protected:
 
+    // Register ports which are not part of the Inputs/Outputs lists.
+    void addInput(InputPort *port) { m_inputs.push_back(port); }
+    void addOutput(OutputPort *port) { m_outputs.push_back(port); }
+
+    // Whether the graph passes the inputs with consume(), see latency().
+    bool decoupled() const { return m_consume != Consume::Never; }
+
     double timeStep() const;
     double sampleRate() const;
 
-private:
-    Node(const Node&) = delete;
-    Node& operator =(const Node&) = delete;
+    // Make the graph prepare again before the next evaluation.
+    void invalidateGraph();
 
-    // Reference to a graph this node belongs to.
-    Graph &m_graph;
-};
+    // Make the graph evaluate this node on the next tick.
+    void markDirty();
 
-//----------------------------------------------------------
-// Some predefined nodes
+    // Whether the graph computed the node once, depending only on constants.
+    bool folded() const { return m_folded; }
 
-namespace node {
+    /// Evaluate a single frame of the current block.
+    void evaluateFrame(std::size_t frame)
+    {
+        seek(frame);
+        evaluate();
+    }
 
-/**
- * @brief Variable value node.
- * This node holds a single value to be connected to inputs.
- */
-template <typename T>
-class Variable : public Node,
-                 public Outputs<T>
-{
-public:
+private:
+    Node(const Node&) = delete;
+    Node& operator =(const Node&) = delete;
 
-    Variable(Graph &g)
-        : Node(g)
-    {}
+    // Register an input created after the node, see InputArray.
+    void attachInput(InputPort *port)
+    {
+        port->m_pNode = this;
+        m_inputs.push_back(port);
+        invalidateGraph();
+    }
 
-    Variable& operator =(const T &value)
+    void detachInput(InputPort *port)
     {
-        Outputs<T>::firstOutput() = value;
-        return *this;
+        m_inputs.erase(std::remove(m_inputs.begin(), m_inputs.end(), port), m_inputs.end());
+        invalidateGraph();
     }
 
-    Variable& operator >> (Input<T> &input)
+    // Point the ports to the given frame.
+    void seek(std::size_t frame)
     {
-        Outputs<T>::firstOutput() >> input;
-        return *this;
+        for (auto *port : m_inputs)
+            port->seek(frame);
+        for (auto *port : m_outputs)
+            port->seek(frame);
     }
 
-};
+    // Evaluate the frames falling on the node rate, holding the outputs in between.
+    virtual void processDivided(std::size_t frames, std::size_t first)
+    {
+        std::size_t held = 0;
+        for (std::size_t i = first; i < frames; i += m_rateDivisor) {
+            for (auto *port : m_outputs)
+                port->hold(held, i);
+            evaluateFrame(i);
+            held = i + 1;
+        }
 
-/**
- * @brief White node generator.
- */
-template <typename T>
-class WhiteNoise : public Node,
-                   public Outputs<T>
-{
-public:
+        for (auto *port : m_outputs)
+            port->hold(held, frames);
+    }
 
-    WhiteNoise(Graph &g, const T min = 0, const T max = 1)
-        : Node(g),
-          m_randomEngine(),
-          m_distribution(min, max)
+    // Fill the blocks of inputs not connected to outputs.
+    void fill(std::size_t frames)
     {
+        for (auto *port : m_inputs) {
+            if (port->source() == nullptr)
+                port->fill(frames);
+        }
     }
 
-    void range(const T min, const T max)
+    void rewind(std::size_t frames)
     {
-        m_distribution = std::uniform_real_distribution<>(min, max);
+        for (auto *port : m_inputs)
+            port->rewind(frames);
+        for (auto *port : m_outputs)
+            port->rewind(frames);
     }
 
+    // Reference to a graph this node belongs to.
+    Graph &m_graph;
+
+    // Registration index within the graph.
+    std::size_t m_index;
+
+    std::string m_name;
+
+    // The node is evaluated once every m_rateDivisor frames.
+    std::size_t m_rateDivisor;
+
+    // When the inputs are passed with consume() rather than read on evaluation.
+    enum class Consume
+    {
+        Never,
+        AfterBlock,
+        AfterFrame
+    };
+
+    Consume m_consume;
+
+    // Evaluated when the graph was prepared, see Graph::simplify().
+    bool m_folded;
+
+    // Ports of this node, collected on registration.
+    std::vector<InputPort*> m_inputs;
+    std::vector<OutputPort*> m_outputs;
+};
+
+/**
+ * @brief Elementwise operation that can be fused with the adjacent ones.
+ * Built-in arithmetic nodes implement this interface, so that the graph
+ * can compute chains of them with a single node (see Graph::fusion()).
+ */
+class Fusable
+{
+public:
+
+    enum class Operation
+    {
+        Neg,
+        Add,
+        Sub,
+        Mul,
+        Div
+    };
+
+    virtual ~Fusable() {}
+
+    virtual Operation operation() const = 0;
+
+    /// Whether this operation can be computed as part of the other one.
+    virtual bool fusableWith(const Fusable &other) const = 0;
+
+    /**
+     * @brief Create a node computing the expression ending with this operation.
+     * Inputs connected to the nodes for which internal() returns true
+     * are computed in place rather than read from those nodes outputs.
+     */
+    virtual std::unique_ptr<Node> fuse(const std::function<bool(const Node*)> &internal) = 0;
+};
+
+/**
+ * @brief Inputs of the same type, added and removed at run time.
+ * Nodes taking any number of values (see node::Sum) derive from this
+ * list rather than a fixed Inputs list. Changing the number of inputs
+ * makes the graph prepare again.
+ *
+ * @code
+ * auto &sum = g.sum<float>(0);
+ * a.out<0>() >> sum.add();
+ * b.out<0>() >> sum.add();
+ * @endcode
+ */
+template <typename T>
+class InputArray
+{
+public:
+
+    /// Create a number of inputs, holding the given value until connected.
+    InputArray(Node &node, std::size_t count = 0, const T &value = T())
+        : m_node(node),
+          m_value(value),
+          m_ports()
+    {
+        resize(count);
+    }
+
+    std::size_t size() const { return m_ports.size(); }
+
+    Input<T>& in(std::size_t i) { return *m_ports[i]; }
+    const Input<T>& in(std::size_t i) const { return *m_ports[i]; }
+
+    /// Append an input.
+    Input<T>& add()
+    {
+        m_ports.emplace_back(new Input<T>());
+        Input<T> &input = *m_ports.back();
+        input = m_value;
+        m_node.attachInput(&input);
+        return input;
+    }
+
+    /// Append or remove the last inputs.
+    void resize(std::size_t count)
+    {
+        while (m_ports.size() > count) {
+            m_node.detachInput(m_ports.back().get());
+            m_ports.pop_back();
+        }
+        while (m_ports.size() < count)
+            add();
+    }
+
+private:
+
+    Node &m_node;
+
+    // Value of the inputs not connected.
+    T m_value;
+
+    std::vector<std::unique_ptr<Input<T> > > m_ports;
+};
+
+//----------------------------------------------------------
+// Some predefined nodes
+
+namespace node {
+
+/**
+ * @brief Base class for the built-in elementwise nodes.
+ */
+template <typename T>
+class Elementwise : public Node,
+                    public Fusable
+{
+public:
+
+    Elementwise(Graph &g)
+        : Node(g)
+    {}
+
+    bool pure() const override { return true; }
+
+    bool fusableWith(const Fusable &other) const override
+    {
+        return dynamic_cast<const Elementwise<T>*>(&other) != nullptr;
+    }
+
+    std::unique_ptr<Node> fuse(const std::function<bool(const Node*)> &internal) override;
+};
+
+/**
+ * @brief Variable value node.
+ * This node holds a single value to be connected to inputs.
+ */
+template <typename T>
+class Variable : public Node,
+                 public Outputs<T>
+{
+public:
+
+    /// Maximal number of value changes within a block.
+    static constexpr std::size_t MaxChanges = 16;
+
+    Variable(Graph &g)
+        : Node(g),
+          m_constant(false),
+          m_changes()
+    {
+        m_changes.reserve(MaxChanges);
+    }
+
+    Variable& operator =(const T &value)
+    {
+        Outputs<T>::firstOutput() = value;
+
+        // Values computed from a constant must be folded again
+        if (m_constant)
+            invalidateGraph();
+        else
+            markDirty();
+
+        return *this;
+    }
+
+    /**
+     * @brief Mark the variable as a constant, or as a live parameter (default).
+     * Nodes depending only on constants get evaluated once when the graph
+     * is prepared. Assigning a constant is allowed, but it makes the graph
+     * prepare again.
+     */
+    void constant(bool isConstant)
+    {
+        m_constant = isConstant;
+        invalidateGraph();
+    }
+
+    bool constant() const override { return m_constant; }
+
+    std::size_t stateSize() const override { return raw::size<bool>(); }
+    void saveState(void *pData) const override { raw::save(pData, m_constant); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != stateSize())
+            return false;
+
+        bool isConstant = false;
+        raw::load(pData, isConstant);
+        if (isConstant != m_constant)
+            constant(isConstant);
+        return true;
+    }
+
+    bool alwaysDirty() const override { return false; }
+
+    /**
+     * @brief Change the value at the given frame of the next block.
+     * Changes exceeding MaxChanges are merged into the last one.
+     */
+    void schedule(std::size_t frame, const T &value)
+    {
+        if (frame == 0 || m_constant) {
+            *this = value;
+            return;
+        }
+
+        if (m_changes.size() == MaxChanges) {
+            m_changes.back().value = value;
+            return;
+        }
+
+        // Keep the changes sorted, the latest one winning on the same frame
+        auto it = std::upper_bound(m_changes.begin(), m_changes.end(), frame,
+                                   [](std::size_t f, const Change &change) { return f < change.frame; });
+        m_changes.insert(it, Change { frame, value });
+    }
+
+    Variable& operator >> (Input<T> &input)
+    {
+        Outputs<T>::firstOutput() >> input;
+        return *this;
+    }
+
+    void process(std::size_t frames) override
+    {
+        auto &output = Outputs<T>::firstOutput();
+        T *out = output.block();
+        std::size_t begin = 0;
+
+        for (const auto &change : m_changes) {
+            const std::size_t end = std::min(change.frame, frames);
+            std::fill(out + begin, out + end, output.value());
+            output = change.value;
+            begin = end;
+        }
+
+        std::fill(out + begin, out + frames, output.value());
+        m_changes.clear();
+    }
+
+private:
+
+    // At a lower rate, the value only changes on the frames due, taking the changes scheduled by then.
+    void processDivided(std::size_t frames, std::size_t first) override
+    {
+        auto &output = Outputs<T>::firstOutput();
+        T *out = output.block();
+        std::size_t begin = 0;
+        std::size_t applied = 0;
+
+        for (std::size_t i = first; i < frames; i += rateDivisor()) {
+            std::fill(out + begin, out + i, output.value());
+            while (applied < m_changes.size() && m_changes[applied].frame <= i)
+                output = m_changes[applied++].value;
+            begin = i;
+        }
+
+        std::fill(out + begin, out + frames, output.value());
+
+        // The changes past the last frame due apply on the next one
+        m_changes.erase(m_changes.begin(), m_changes.begin() + applied);
+        for (auto &change : m_changes)
+            change.frame = 0;
+    }
+
+    struct Change
+    {
+        std::size_t frame;
+        T value;
+    };
+
+    bool m_constant;
+
+    // Changes scheduled within the current block.
+    std::vector<Change> m_changes;
+};
+
+/**
+ * @brief White node generator.
+ */
+template <typename T>
+class WhiteNoise : public Node,
+                   public Outputs<T>
+{
+public:
+
+    WhiteNoise(Graph &g, const T min = 0, const T max = 1)
+        : Node(g),
+          m_min(min),
+          m_max(max),
+          m_random(),
+          m_seeded(false)
+    {
+    }
+
+    void range(const T min, const T max)
+    {
+        m_min = min;
+        m_max = max;
+    }
+
+    /**
+     * @brief Select the random stream.
+     * Unless seeded, each node uses the stream of its index in the graph,
+     * so that a graph built the same way generates the same noise.
+     */
+    void seed(std::uint64_t seed, std::uint64_t stream = 0)
+    {
+        m_random.seed(seed, stream);
+        m_seeded = true;
+    }
+
+    bool alwaysDirty() const override { return true; }
+
+    void inheritState(const Node &previous) override
+    {
+        if (const auto *pPrevious = dynamic_cast<const WhiteNoise<T>*>(&previous)) {
+            m_random = pPrevious->m_random;
+            m_seeded = pPrevious->m_seeded;
+        }
+    }
+
+    std::size_t stateSize() const override { return raw::size<T, T, Random, bool>(); }
+    void saveState(void *pData) const override { raw::save(pData, m_min, m_max, m_random, m_seeded); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != stateSize())
+            return false;
+        raw::load(pData, m_min, m_max, m_random, m_seeded);
+        return true;
+    }
+
+    void evaluate() override
+    {
+        if (!m_seeded)
+            seed(0, index());
+
+        Outputs<T>::firstOutput() = m_random.uniform(m_min, m_max);
+    }
+
+    void process(std::size_t frames) override
+    {
+        if (!m_seeded)
+            seed(0, index());
+
+        m_random.uniform(Outputs<T>::firstOutput().block(), frames, m_min, m_max);
+    }
+
+private:
+    T m_min;
+    T m_max;
+    Random m_random;
+    bool m_seeded;
+};
+
+/**
+ * @brief Linear ramp generator.
+ * The output moves linearly to the target value over the given time,
+ * then holds it.
+ */
+template <typename T>
+class Ramp : public Node,
+             public Outputs<T>
+{
+public:
+
+    Ramp(Graph &g, const T &value = T())
+        : Node(g),
+          m_start(value),
+          m_target(value),
+          m_step(),
+          m_position(0),
+          m_length(0)
+    {
+        Outputs<T>::firstOutput() = value;
+    }
+
+    /// Start moving from the current value to the target, over given time in seconds.
+    void to(const T &target, double seconds)
+    {
+        m_start = Outputs<T>::firstOutput().value();
+        m_target = target;
+        m_position = 0;
+        m_length = std::size_t(std::round(seconds * sampleRate()));
+
+        if (m_length == 0)
+            Outputs<T>::firstOutput() = target;
+        else
+            m_step = (m_target - m_start) / T(m_length);
+
+        markDirty();
+    }
+
+    const T& target() const { return m_target; }
+
+    /// Whether the ramp has not reached its target yet.
+    bool active() const { return m_position < m_length; }
+
+    std::size_t stateSize() const override { return raw::size<T, T, T, std::size_t, std::size_t>(); }
+    void saveState(void *pData) const override { raw::save(pData, m_start, m_target, m_step, m_position, m_length); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != stateSize())
+            return false;
+        raw::load(pData, m_start, m_target, m_step, m_position, m_length);
+        markDirty();
+        return true;
+    }
+
+    void evaluate() override
+    {
+        if (active())
+            Outputs<T>::firstOutput() = value(++m_position);
+    }
+
+    void process(std::size_t frames) override
+    {
+        auto &output = Outputs<T>::firstOutput();
+        T *out = output.block();
+
+        const std::size_t count = std::min(frames, m_length - m_position);
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = value(m_position + i + 1);
+
+        m_position += count;
+        std::fill(out + count, out + frames, count > 0 ? out[count - 1] : output.value());
+    }
+
+private:
+
+    // Value at the given position, values are computed from the
+    // start of the ramp rather than accumulated to avoid drifting.
+    T value(std::size_t position) const
+    {
+        return position == m_length ? m_target : m_start + m_step * T(position);
+    }
+
+    T m_start;
+    T m_target;
+    T m_step;
+    std::size_t m_position;
+    std::size_t m_length;
+};
+
+/**
+ * @brief One-pole smoothing filter.
+ * The output follows the input with the given time constant,
+ * avoiding the steps when the input value changes.
+ */
+template <typename T>
+class Smoother : public Node,
+                 public Inputs<T>,
+                 public Outputs<T>
+{
+public:
+
+    Smoother(Graph &g, double seconds = 0.01)
+        : Node(g),
+          m_time(seconds),
+          m_timeStep(0.0),
+          m_coefficient()
+    {
+    }
+
+    /// Time constant, in seconds.
+    double time() const { return m_time; }
+    void time(double seconds)
+    {
+        m_time = seconds;
+        m_timeStep = 0.0;
+    }
+
+    /// Jump to the input value.
+    void reset()
+    {
+        Outputs<T>::firstOutput() = Inputs<T>::firstInput().value();
+    }
+
+    std::size_t stateSize() const override { return raw::size<double>(); }
+    void saveState(void *pData) const override { raw::save(pData, m_time); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != stateSize())
+            return false;
+        raw::load(pData, m_time);
+        m_timeStep = 0.0;
+        return true;
+    }
+
+    void evaluate() override
+    {
+        const T a = coefficient();
+        auto &output = Outputs<T>::firstOutput();
+        output = output.value() + (Inputs<T>::firstInput().value() - output.value()) * a;
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T a = coefficient();
+        const T *in = Inputs<T>::firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        T y = Outputs<T>::firstOutput().value();
+
+        for (std::size_t i = 0; i < frames; ++i) {
+            y = y + (in[i] - y) * a;
+            out[i] = y;
+        }
+    }
+
+private:
+
+    // Recomputed when the sample rate or the time changes.
+    T coefficient()
+    {
+        if (timeStep() != m_timeStep) {
+            m_timeStep = timeStep();
+            m_coefficient = m_time > 0.0 ? T(1.0 - std::exp(-m_timeStep / m_time)) : T(1);
+        }
+        return m_coefficient;
+    }
+
+    double m_time;
+    double m_timeStep;
+    T m_coefficient;
+};
+
+/**
+ * @brief Breakpoints automation.
+ * Generates the values interpolated linearly between the breakpoints,
+ * holding the first and the last values outside of them. Time starts
+ * at zero on the first evaluation.
+ */
+template <typename T>
+class Automation : public Node,
+                   public Outputs<T>
+{
+public:
+
+    struct Point
+    {
+        double time;    ///< Time in seconds.
+        T value;
+    };
+
+    Automation(Graph &g)
+        : Node(g),
+          m_points(),
+          m_frame(0),
+          m_segment(0)
+    {
+    }
+
+    /// Add a breakpoint, points are kept sorted by time.
+    void add(double time, const T &value)
+    {
+        auto it = std::upper_bound(m_points.begin(), m_points.end(), time,
+                                   [](double t, const Point &point) { return t < point.time; });
+        m_points.insert(it, Point { time, value });
+        m_segment = 0;
+    }
+
+    void clear()
+    {
+        m_points.clear();
+        m_segment = 0;
+    }
+
+    const std::vector<Point>& points() const { return m_points; }
+
+    /// Current time, in seconds.
+    double position() const { return double(m_frame) * timeStep(); }
+
+    /// Move to the given time, in seconds.
+    void position(double seconds)
+    {
+        m_frame = std::size_t(std::round(seconds * sampleRate()));
+        m_segment = 0;
+    }
+
+    /// Position followed by the points.
+    std::size_t stateSize() const override
+    {
+        return raw::size<Point>() == 0 ? 0 : raw::size<std::size_t>() + m_points.size() * raw::size<Point>();
+    }
+
+    void saveState(void *pData) const override
+    {
+        if (stateSize() == 0)
+            return;
+
+        raw::save(pData, m_frame);
+        for (std::size_t i = 0; i < m_points.size(); ++i)
+            raw::save(static_cast<char*>(pData) + raw::size<std::size_t>() + i * raw::size<Point>(), m_points[i]);
+    }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (raw::size<Point>() == 0 || size < raw::size<std::size_t>()
+            || (size - raw::size<std::size_t>()) % raw::size<Point>() != 0)
+            return size == 0 && raw::size<Point>() == 0;
+
+        raw::load(pData, m_frame);
+        m_points.resize((size - raw::size<std::size_t>()) / raw::size<Point>());
+        for (std::size_t i = 0; i < m_points.size(); ++i)
+            raw::load(static_cast<const char*>(pData) + raw::size<std::size_t>() + i * raw::size<Point>(), m_points[i]);
+        m_segment = 0;
+        return true;
+    }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = value(m_frame++);
+    }
+
+    void process(std::size_t frames) override
+    {
+        T *out = Outputs<T>::firstOutput().block();
+        for (std::size_t i = 0; i < frames; ++i)
+            out[i] = value(m_frame++);
+    }
+
+private:
+
+    T value(std::size_t frame)
+    {
+        if (m_points.empty())
+            return T();
+
+        const double t = double(frame) * timeStep();
+
+        if (t <= m_points.front().time)
+            return m_points.front().value;
+        if (t >= m_points.back().time)
+            return m_points.back().value;
+
+        // Time only moves forward between the seeks
+        while (m_points[m_segment + 1].time <= t)
+            ++m_segment;
+
+        const Point &a = m_points[m_segment];
+        const Point &b = m_points[m_segment + 1];
+        return a.value + (b.value - a.value) * T((t - a.time) / (b.time - a.time));
+    }
+
+    std::vector<Point> m_points;
+
+    // Next frame to compute, and the segment it belongs to.
+    std::size_t m_frame;
+    std::size_t m_segment;
+};
+
+/**
+ * @brief Linear interpolation of a lower rate signal.
+ * When the input changes, the output moves linearly to the new value
+ * over one period of the node the input is connected to, rather than
+ * holding the value until the next change. This delays the signal by
+ * one period.
+ */
+template <typename T>
+class Interpolator : public Node,
+                     public Inputs<T>,
+                     public Outputs<T>
+{
+public:
+
+    Interpolator(Graph &g)
+        : Node(g),
+          m_target(),
+          m_step(),
+          m_remaining(0)
+    {
+    }
+
+    std::size_t stateSize() const override { return raw::size<T, T, std::size_t>(); }
+    void saveState(void *pData) const override { raw::save(pData, m_target, m_step, m_remaining); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != stateSize())
+            return false;
+        raw::load(pData, m_target, m_step, m_remaining);
+        return true;
+    }
+
+    void evaluate() override
+    {
+        auto &input = Inputs<T>::firstInput();
+        auto &output = Outputs<T>::firstOutput();
+
+        if (input.value() != m_target) {
+            m_target = input.value();
+            m_remaining = period();
+            m_step = (m_target - output.value()) / T(m_remaining);
+        }
+
+        if (m_remaining > 0) {
+            --m_remaining;
+            output = m_remaining == 0 ? m_target : output.value() + m_step;
+        }
+    }
+
+private:
+
+    // Number of frames of this node between the input updates.
+    std::size_t period()
+    {
+        const OutputPort *pSource = Inputs<T>::firstInput().source();
+        if (pSource == nullptr || pSource->node() == nullptr)
+            return 1;
+
+        return std::max<std::size_t>(1, pSource->node()->rateDivisor() / rateDivisor());
+    }
+
+    T m_target;
+    T m_step;
+    std::size_t m_remaining;
+};
+
+/**
+ * @brief Delay line.
+ * The output is the input of a given number of frames earlier, kept in a
+ * power of two ring buffer. A delay at least as long as the block breaks the
+ * feedback loops it is part of (see Node::latency()), so that these get
+ * processed block by block rather than frame by frame. Blocks are copied
+ * to and from the buffer in at most two contiguous parts.
+ */
+template <typename T>
+class Delay : public Node,
+              public Inputs<T>,
+              public Outputs<T>
+{
+public:
+
+    Delay(Graph &g, std::size_t length = 1)
+        : Node(g),
+          m_length(length),
+          m_buffer(),
+          m_mask(0),
+          m_position(0)
+    {
+        grow(length + 1);
+    }
+
+    std::size_t length() const { return m_length; }
+
+    void length(std::size_t frames)
+    {
+        m_length = frames;
+        grow(frames + 1);
+        invalidateGraph();
+    }
+
+    std::size_t latency() const override { return m_length; }
+
+    void reserve(std::size_t frames) override { grow(m_length + std::max<std::size_t>(frames, 1)); }
+
+    void evaluate() override
+    {
+        if (!decoupled())
+            m_buffer[m_position++ & m_mask] = Inputs<T>::firstInput().value();
+
+        Outputs<T>::firstOutput() = m_buffer[(m_position - m_length - (decoupled() ? 0 : 1)) & m_mask];
+    }
+
+    void process(std::size_t frames) override
+    {
+        const std::size_t from = m_position - m_length;
+
+        if (!decoupled())
+            write(Inputs<T>::firstInput().block(), frames);
+
+        read(from, Outputs<T>::firstOutput().block(), frames);
+    }
+
+    void consume(std::size_t frames) override
+    {
+        if (frames == 0)
+            m_buffer[m_position++ & m_mask] = Inputs<T>::firstInput().value();
+        else
+            write(Inputs<T>::firstInput().block(), frames);
+    }
+
+    void inheritState(const Node &previous) override
+    {
+        if (const auto *pPrevious = dynamic_cast<const Delay<T>*>(&previous)) {
+            const std::size_t count = std::min(m_length, pPrevious->m_length);
+            for (std::size_t i = 1; i <= count; ++i)
+                m_buffer[(m_position - i) & m_mask] = pPrevious->m_buffer[(pPrevious->m_position - i) & pPrevious->m_mask];
+        }
+    }
+
+    // The length and position, followed by the frames in the line.
+    std::size_t stateSize() const override
+    {
+        return raw::size<std::size_t, std::size_t>() + m_length * raw::size<T>();
+    }
+
+    void saveState(void *pData) const override
+    {
+        char *p = static_cast<char*>(pData);
+        raw::save(p, m_length, m_position);
+        p += raw::size<std::size_t, std::size_t>();
+
+        for (std::size_t i = 0; i < m_length; ++i, p += raw::size<T>())
+            raw::save(p, m_buffer[(m_position - m_length + i) & m_mask]);
+    }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        const char *p = static_cast<const char*>(pData);
+        std::size_t length = 0;
+        std::size_t position = 0;
+
+        if (size < raw::size<std::size_t, std::size_t>())
+            return false;
+
+        raw::load(p, length, position);
+
+        // The frames must be there, the length is not restored otherwise
+        const std::size_t frames = size - raw::size<std::size_t, std::size_t>();
+        if (raw::size<T>() == 0 ? frames != 0 || length != m_length
+                                : frames % raw::size<T>() != 0 || frames / raw::size<T>() != length)
+            return false;
+
+        if (length != m_length)
+            Delay::length(length);
+
+        m_position = position;
+        p += raw::size<std::size_t, std::size_t>();
+        for (std::size_t i = 0; i < m_length; ++i, p += raw::size<T>())
+            raw::load(p, m_buffer[(m_position - m_length + i) & m_mask]);
+
+        return true;
+    }
+
+private:
+
+    // Make room for the given number of frames, keeping the positions of the ones stored.
+    void grow(std::size_t frames)
+    {
+        std::size_t size = 1;
+        while (size < frames)
+            size <<= 1;
+
+        if (size <= m_buffer.size())
+            return;
+
+        std::vector<T> buffer(size, T());
+        for (std::size_t i = 1; i <= m_buffer.size(); ++i)
+            buffer[(m_position - i) & (size - 1)] = m_buffer[(m_position - i) & m_mask];
+
+        m_buffer.swap(buffer);
+        m_mask = size - 1;
+    }
+
+    void write(const T *in, std::size_t frames)
+    {
+        const std::size_t begin = m_position & m_mask;
+        const std::size_t first = std::min(frames, m_buffer.size() - begin);
+
+        std::copy(in, in + first, m_buffer.begin() + begin);
+        std::copy(in + first, in + frames, m_buffer.begin());
+        m_position += frames;
+    }
+
+    void read(std::size_t from, T *out, std::size_t frames) const
+    {
+        const std::size_t begin = from & m_mask;
+        const std::size_t first = std::min(frames, m_buffer.size() - begin);
+
+        std::copy(m_buffer.begin() + begin, m_buffer.begin() + begin + first, out);
+        std::copy(m_buffer.begin(), m_buffer.begin() + (frames - first), out + first);
+    }
+
+    std::size_t m_length;
+
+    // Ring buffer, the frame at position k being stored at k & m_mask.
+    std::vector<T> m_buffer;
+    std::size_t m_mask;
+
+    // Frames written so far.
+    std::size_t m_position;
+};
+
+/**
+ * @brief Frames read from memory provided by the caller.
+ * In block mode the contiguous frames (stride of 1) are not copied: the nodes
+ * connected to the source read them in place. The source must be evaluated
+ * at the graph rate. Frames past the bound ones hold the last value.
+ */
+template <typename T>
+class Source : public Node,
+               public Outputs<T>
+{
+public:
+
+    Source(Graph &g)
+        : Node(g),
+          m_pData(nullptr),
+          m_frames(0),
+          m_stride(1),
+          m_position(0)
+    {
+    }
+
+    /**
+     * @brief Read the next frames from the given memory.
+     * @param pData First frame.
+     * @param frames Number of frames available.
+     * @param stride Distance between the frames, in values.
+     */
+    void bind(const T *pData, std::size_t frames, std::size_t stride = 1)
+    {
+        m_pData = pData;
+        m_frames = pData != nullptr ? frames : 0;
+        m_stride = stride;
+        m_position = 0;
+    }
+
+    bool alwaysDirty() const override { return true; }
+
+    void evaluate() override
+    {
+        auto &output = Outputs<T>::firstOutput();
+        output.bind(nullptr);
+
+        if (m_position < m_frames)
+            output = m_pData[m_position++ * m_stride];
+    }
+
+    void process(std::size_t frames) override
+    {
+        auto &output = Outputs<T>::firstOutput();
+        const std::size_t count = std::min(frames, m_frames - m_position);
+
+        if (m_stride == 1 && count == frames) {
+            // Only read by the connected inputs
+            output.view(m_pData + m_position);
+        } else {
+            output.bind(nullptr);
+            T *out = output.block();
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = m_pData[(m_position + i) * m_stride];
+            output.hold(count, frames);
+        }
+
+        m_position += count;
+    }
+
+private:
+    const T *m_pData;
+    std::size_t m_frames;
+    std::size_t m_stride;
+    std::size_t m_position;
+};
+
+/**
+ * @brief Frames written to memory provided by the caller.
+ * In block mode, with a stride of 1, the output connected to the sink gets
+ * bound to the memory (see Output::bind()), so that the frames are written
+ * there directly, without copying, as long as a whole block fits in the
+ * frames left. The last frames are copied from the output own storage.
+ */
+template <typename T>
+class Sink : public Node,
+             public Inputs<T>
+{
+public:
+
+    Sink(Graph &g)
+        : Node(g),
+          m_pData(nullptr),
+          m_frames(0),
+          m_stride(1),
+          m_position(0),
+          m_blockSize(0),
+          m_pBound(nullptr)
+    {
+    }
+
+    /**
+     * @brief Write the next frames to the given memory.
+     * @param pData First frame.
+     * @param frames Number of frames available.
+     * @param stride Distance between the frames, in values.
+     */
+    void bind(T *pData, std::size_t frames, std::size_t stride = 1)
+    {
+        release();
+
+        m_pData = pData;
+        m_frames = pData != nullptr ? frames : 0;
+        m_stride = stride;
+        m_position = 0;
+
+        if (m_stride == 1 && fits()) {
+            m_pBound = source();
+            if (m_pBound != nullptr)
+                m_pBound->bind(m_pData);
+        }
+    }
+
+    bool alwaysDirty() const override { return true; }
+
+    void reserve(std::size_t frames) override
+    {
+        m_blockSize = frames;
+
+        // A larger block would be written past the frames left
+        if (!fits())
+            release();
+    }
+
+    void evaluate() override
+    {
+        if (m_position < m_frames)
+            m_pData[m_position++ * m_stride] = Inputs<T>::firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *in = Inputs<T>::firstInput().block();
+        T *out = m_pData + m_position * m_stride;
+        const std::size_t count = std::min(frames, m_frames - m_position);
+
+        if (in != out) {
+            for (std::size_t i = 0; i < count; ++i)
+                out[i * m_stride] = in[i];
+        }
+
+        m_position += count;
+
+        // Let the output write the next block in place
+        if (m_pBound != nullptr) {
+            if (fits() && m_pBound->block() == out)
+                m_pBound->bind(m_pData + m_position);
+            else
+                release();
+        }
+    }
+
+private:
+
+    Output<T>* source()
+    {
+        return static_cast<Output<T>*>(Inputs<T>::firstInput().source());
+    }
+
+    // Whether a whole block fits in the frames left.
+    bool fits() const
+    {
+        return m_frames - m_position >= std::max<std::size_t>(m_blockSize, 1);
+    }
+
+    // Return the bound output to its own storage.
+    void release()
+    {
+        if (m_pBound != nullptr && m_pBound == source())
+            m_pBound->bind(nullptr);
+        m_pBound = nullptr;
+    }
+
+    T *m_pData;
+    std::size_t m_frames;
+    std::size_t m_stride;
+    std::size_t m_position;
+    std::size_t m_blockSize;
+    Output<T> *m_pBound;
+};
+
+/**
+ * @brief Input sign change node.
+ */
+template <typename T>
+class Neg : public Elementwise<T>,
+                   public Inputs<T>,
+                   public Outputs<T>
+{
+public:
+
+    Neg(Graph &g)
+        : Elementwise<T>(g)
+    {}
+
+    Fusable::Operation operation() const override { return Fusable::Operation::Neg; }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = -Inputs<T>::firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *in = Inputs<T>::firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        simd::unary<simd::NegOp>(in, out, frames);
+    }
+};
+
+/**
+ * @brief Add two values.
+ */
+template <typename T>
+class Add : public Elementwise<T>,
+                   public Inputs<T, T>,
+                   public Outputs<T>
+{
+public:
+
+    Add(Graph &g)
+        : Elementwise<T>(g)
+    {}
+
+    Fusable::Operation operation() const override { return Fusable::Operation::Add; }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
+            + Inputs<T, T>::otherInputs().firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *a = Inputs<T, T>::firstInput().block();
+        const T *b = Inputs<T, T>::otherInputs().firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        simd::binary<simd::AddOp>(a, b, out, frames);
+    }
+};
+
+/**
+ * @brief Subtract two values.
+ */
+template <typename T>
+class Sub : public Elementwise<T>,
+                   public Inputs<T, T>,
+                   public Outputs<T>
+{
+public:
+
+    Sub(Graph &g)
+        : Elementwise<T>(g)
+    {}
+
+    Fusable::Operation operation() const override { return Fusable::Operation::Sub; }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
+            - Inputs<T, T>::otherInputs().firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *a = Inputs<T, T>::firstInput().block();
+        const T *b = Inputs<T, T>::otherInputs().firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        simd::binary<simd::SubOp>(a, b, out, frames);
+    }
+};
+
+/**
+ * @brief Multiply two values.
+ */
+template <typename T>
+class Mul : public Elementwise<T>,
+                   public Inputs<T, T>,
+                   public Outputs<T>
+{
+public:
+
+    Mul(Graph &g)
+        : Elementwise<T>(g)
+    {}
+
+    Fusable::Operation operation() const override { return Fusable::Operation::Mul; }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
+            * Inputs<T, T>::otherInputs().firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *a = Inputs<T, T>::firstInput().block();
+        const T *b = Inputs<T, T>::otherInputs().firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        simd::binary<simd::MulOp>(a, b, out, frames);
+    }
+};
+
+/**
+ * @brief Divide two values.
+ */
+template <typename T>
+class Div : public Elementwise<T>,
+                   public Inputs<T, T>,
+                   public Outputs<T>
+{
+public:
+
+    Div(Graph &g)
+        : Elementwise<T>(g)
+    {}
+
+    Fusable::Operation operation() const override { return Fusable::Operation::Div; }
+
+    void evaluate() override
+    {
+        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
+            / Inputs<T, T>::otherInputs().firstInput().value();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const T *a = Inputs<T, T>::firstInput().block();
+        const T *b = Inputs<T, T>::otherInputs().firstInput().block();
+        T *out = Outputs<T>::firstOutput().block();
+        simd::binary<simd::DivOp>(a, b, out, frames);
+    }
+};
+
+/**
+ * @brief Reduction of any number of values by an elementwise operation.
+ * The block is computed with one vectorized pass per input over the
+ * output, which stays in the cache.
+ */
+template <typename T, class Op>
+class Reduction : public Node,
+                  public InputArray<T>,
+                  public Outputs<T>
+{
+public:
+
+    /// The identity of the operation is the output of no inputs.
+    Reduction(Graph &g, std::size_t inputs, const T &identity)
+        : Node(g),
+          InputArray<T>(*this, inputs, identity),
+          m_identity(identity)
+    {}
+
+    bool pure() const override { return true; }
+
+    void evaluate() override
+    {
+        T value = m_identity;
+        if (InputArray<T>::size() > 0) {
+            value = InputArray<T>::in(0).value();
+            for (std::size_t i = 1; i < InputArray<T>::size(); ++i)
+                value = Op::template apply<simd::Scalar<T> >(value, InputArray<T>::in(i).value());
+        }
+        Outputs<T>::firstOutput() = value;
+    }
+
+    void process(std::size_t frames) override
+    {
+        T *out = Outputs<T>::firstOutput().block();
+
+        if (InputArray<T>::size() == 0) {
+            std::fill(out, out + frames, m_identity);
+            return;
+        }
+
+        const T *first = InputArray<T>::in(0).block();
+        if (first != out)
+            std::copy(first, first + frames, out);
+
+        for (std::size_t i = 1; i < InputArray<T>::size(); ++i)
+            simd::binary<Op>(static_cast<const T*>(out), InputArray<T>::in(i).block(), out, frames);
+    }
+
+    bool resizeInputs(std::size_t count) override
+    {
+        InputArray<T>::resize(count);
+        return true;
+    }
+
+    // The number of inputs, their values are saved with the ports.
+    std::size_t stateSize() const override { return raw::size<std::size_t>(); }
+
+    void saveState(void *pData) const override { raw::save(pData, InputArray<T>::size()); }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size != raw::size<std::size_t>())
+            return false;
+
+        std::size_t count = 0;
+        raw::load(pData, count);
+        return count == InputArray<T>::size();
+    }
+
+private:
+
+    T m_identity;
+};
+
+/**
+ * @brief Sum of any number of values.
+ */
+template <typename T>
+class Sum : public Reduction<T, simd::AddOp>
+{
+public:
+
+    Sum(Graph &g, std::size_t inputs = 2)
+        : Reduction<T, simd::AddOp>(g, inputs, T())
+    {}
+};
+
+/**
+ * @brief Product of any number of values.
+ * Inputs not connected hold one.
+ */
+template <typename T>
+class Product : public Reduction<T, simd::MulOp>
+{
+public:
+
+    Product(Graph &g, std::size_t inputs = 2)
+        : Reduction<T, simd::MulOp>(g, inputs, T(1))
+    {}
+};
+
+/**
+ * @brief Sum of any number of values, each multiplied by its gain.
+ * Gains default to one.
+ */
+template <typename T>
+class Mix : public Node,
+            public InputArray<T>,
+            public Outputs<T>
+{
+public:
+
+    Mix(Graph &g, std::size_t inputs = 2)
+        : Node(g),
+          InputArray<T>(*this, inputs),
+          m_gains()
+    {}
+
+    T gain(std::size_t i) const { return i < m_gains.size() ? m_gains[i] : T(1); }
+
+    void gain(std::size_t i, const T &g)
+    {
+        if (i >= m_gains.size())
+            m_gains.resize(i + 1, T(1));
+        m_gains[i] = g;
+
+        // The output computed from constants must be folded again
+        if (folded())
+            invalidateGraph();
+        else
+            markDirty();
+    }
+
+    bool pure() const override { return true; }
+
     void evaluate() override
     {
-        Outputs<T>::firstOutput() = m_distribution(m_randomEngine);
+        T value = T();
+        if (InputArray<T>::size() > 0) {
+            value = InputArray<T>::in(0).value() * gain(0);
+            for (std::size_t i = 1; i < InputArray<T>::size(); ++i)
+                value = value + InputArray<T>::in(i).value() * gain(i);
+        }
+        Outputs<T>::firstOutput() = value;
+    }
+
+    void process(std::size_t frames) override
+    {
+        T *out = Outputs<T>::firstOutput().block();
+
+        if (InputArray<T>::size() == 0) {
+            std::fill(out, out + frames, T());
+            return;
+        }
+
+        simd::scale(InputArray<T>::in(0).block(), gain(0), out, frames);
+        for (std::size_t i = 1; i < InputArray<T>::size(); ++i)
+            simd::multiplyAdd(InputArray<T>::in(i).block(), gain(i), out, frames);
+    }
+
+    bool resizeInputs(std::size_t count) override
+    {
+        InputArray<T>::resize(count);
+        return true;
+    }
+
+    // The number of inputs followed by the gains.
+    std::size_t stateSize() const override
+    {
+        return raw::size<std::size_t>() + m_gains.size() * raw::size<T>();
+    }
+
+    void saveState(void *pData) const override
+    {
+        raw::save(pData, InputArray<T>::size());
+        for (std::size_t i = 0; i < m_gains.size(); ++i)
+            raw::save(static_cast<char*>(pData) + raw::size<std::size_t>() + i * raw::size<T>(), m_gains[i]);
+    }
+
+    bool loadState(const void *pData, std::size_t size) override
+    {
+        if (size < raw::size<std::size_t>())
+            return false;
+
+        const std::size_t gains = size - raw::size<std::size_t>();
+        if (raw::size<T>() == 0 ? gains != 0 : gains % raw::size<T>() != 0)
+            return false;
+
+        std::size_t count = 0;
+        raw::load(pData, count);
+        if (count != InputArray<T>::size())
+            return false;
+
+        m_gains.resize(raw::size<T>() == 0 ? 0 : gains / raw::size<T>());
+        for (std::size_t i = 0; i < m_gains.size(); ++i)
+            raw::load(static_cast<const char*>(pData) + raw::size<std::size_t>() + i * raw::size<T>(), m_gains[i]);
+        return true;
+    }
+
+private:
+
+    std::vector<T> m_gains;
+};
+
+/**
+ * @brief Value converted to another type.
+ * Floating point values converted to integers saturate, NaN giving zero,
+ * the conversions being otherwise those of static_cast.
+ */
+template <typename From, typename To>
+class Convert : public Node,
+                public Inputs<From>,
+                public Outputs<To>
+{
+public:
+
+    Convert(Graph &g)
+        : Node(g)
+    {}
+
+    bool pure() const override { return true; }
+
+    void evaluate() override
+    {
+        Outputs<To>::firstOutput() = convert(Inputs<From>::firstInput().value());
+    }
+
+    void process(std::size_t frames) override
+    {
+        const From *in = Inputs<From>::firstInput().block();
+        To *out = Outputs<To>::firstOutput().block();
+
+        for (std::size_t i = 0; i < frames; ++i)
+            out[i] = convert(in[i]);
+    }
+
+    static To convert(const From &value)
+    {
+        return convert(value, std::integral_constant<bool, std::is_integral<To>::value && !std::is_integral<From>::value>());
+    }
+
+private:
+
+    static To convert(const From &value, std::false_type) { return static_cast<To>(value); }
+
+    static To convert(const From &value, std::true_type)
+    {
+        const double v = double(value);
+
+        if (v != v)
+            return To(0);
+        if (v <= double(std::numeric_limits<To>::min()))
+            return std::numeric_limits<To>::min();
+        if (v >= double(std::numeric_limits<To>::max()))
+            return std::numeric_limits<To>::max();
+
+        return static_cast<To>(v);
+    }
+};
+
+/**
+ * @brief Chain of elementwise operations computed by a single node.
+ * Created by the graph when fusion is enabled, it replaces the nodes of
+ * an expression whose intermediate results are not used anywhere else.
+ * Blocks are processed in short tiles, so that the intermediate results
+ * stay in the cache instead of being stored to the nodes outputs.
+ */
+template <typename T>
+class Fused : public Node
+{
+public:
+
+    Fused(Node &root, const std::function<bool(const Node*)> &internal)
+        : Node(root.graph()),
+          m_leaves(),
+          m_code(),
+          m_results(),
+          m_scratch(),
+          m_pOutput(static_cast<Output<T>*>(root.outputs().front()))
+    {
+        compile(root, internal);
+
+        for (auto *pLeaf : m_leaves)
+            addInput(pLeaf);
+        addOutput(m_pOutput);
+
+        m_results.resize(m_code.size());
+        m_scratch.resize(m_code.size() * Tile);
+    }
+
+    /// Number of fused operations.
+    std::size_t size() const { return m_code.size(); }
+
+    bool pure() const override { return true; }
+
+    void evaluate() override
+    {
+        for (std::size_t k = 0; k < m_code.size(); ++k) {
+            const Instruction &op = m_code[k];
+            const T a = value(op.a);
+
+            switch (op.operation) {
+            case Fusable::Operation::Neg: m_results[k] = -a; break;
+            case Fusable::Operation::Add: m_results[k] = a + value(op.b); break;
+            case Fusable::Operation::Sub: m_results[k] = a - value(op.b); break;
+            case Fusable::Operation::Mul: m_results[k] = a * value(op.b); break;
+            case Fusable::Operation::Div: m_results[k] = a / value(op.b); break;
+            }
+        }
+
+        *m_pOutput = m_results.back();
+    }
+
+    void process(std::size_t frames) override
+    {
+        const std::size_t last = m_code.size() - 1;
+
+        for (std::size_t offset = 0; offset < frames; offset += Tile) {
+            const std::size_t count = std::min(frames - offset, std::size_t(Tile));
+
+            for (std::size_t k = 0; k < m_code.size(); ++k) {
+                const Instruction &op = m_code[k];
+                const T *a = tile(op.a, offset);
+                T *out = k == last ? m_pOutput->block() + offset : &m_scratch[k * Tile];
+
+                switch (op.operation) {
+                case Fusable::Operation::Neg: simd::unary<simd::NegOp>(a, out, count); break;
+                case Fusable::Operation::Add: simd::binary<simd::AddOp>(a, tile(op.b, offset), out, count); break;
+                case Fusable::Operation::Sub: simd::binary<simd::SubOp>(a, tile(op.b, offset), out, count); break;
+                case Fusable::Operation::Mul: simd::binary<simd::MulOp>(a, tile(op.b, offset), out, count); break;
+                case Fusable::Operation::Div: simd::binary<simd::DivOp>(a, tile(op.b, offset), out, count); break;
+                }
+            }
+        }
+    }
+
+private:
+
+    static constexpr std::size_t Tile = 64;
+
+    // Instruction operand, either an input or a previous result.
+    struct Operand
+    {
+        bool leaf;
+        std::size_t index;
+    };
+
+    struct Instruction
+    {
+        Fusable::Operation operation;
+        Operand a;
+        Operand b;
+    };
+
+    Operand compile(Node &n, const std::function<bool(const Node*)> &internal)
+    {
+        Operand operands[2] = {};
+        std::size_t count = 0;
+
+        for (auto *port : n.inputs()) {
+            Node *pSource = port->source() != nullptr ? port->source()->node() : nullptr;
+
+            if (pSource != nullptr && internal(pSource)) {
+                operands[count++] = compile(*pSource, internal);
+            } else {
+                operands[count++] = Operand { true, m_leaves.size() };
+                m_leaves.push_back(static_cast<Input<T>*>(port));
+            }
+        }
+
+        m_code.push_back(Instruction { dynamic_cast<Fusable&>(n).operation(), operands[0], operands[1] });
+        return Operand { false, m_code.size() - 1 };
+    }
+
+    const T& value(const Operand &operand) const
+    {
+        return operand.leaf ? m_leaves[operand.index]->value() : m_results[operand.index];
+    }
+
+    const T* tile(const Operand &operand, std::size_t offset) const
+    {
+        return operand.leaf ? m_leaves[operand.index]->block() + offset : &m_scratch[operand.index * Tile];
+    }
+
+    std::vector<Input<T>*> m_leaves;
+    std::vector<Instruction> m_code;
+
+    // Results of a single frame evaluation.
+    std::vector<T> m_results;
+
+    // Tiles of intermediate results of a block processing.
+    std::vector<T> m_scratch;
+
+    Output<T> *m_pOutput;
+};
+
+template <typename T>
+std::unique_ptr<Node> Elementwise<T>::fuse(const std::function<bool(const Node*)> &internal)
+{
+    return std::unique_ptr<Node>(new Fused<T>(*this, internal));
+}
+
+} // namespace node
+//----------------------------------------------------------
+
+/**
+ * @brief Bump allocator for the graph nodes.
+ * Memory is taken from large chunks, so that the nodes are placed next
+ * to each other in the order they are created. Allocated memory never
+ * moves and is released all at once when the arena gets destroyed.
+ */
+class Arena
+{
+public:
+
+    static constexpr std::size_t DefaultChunkSize = 64 * 1024;
+
+    explicit Arena(std::size_t chunkSize = DefaultChunkSize)
+        : m_chunks(),
+          m_pCurrent(nullptr),
+          m_available(0),
+          m_chunkSize(chunkSize),
+          m_allocated(0)
+    {
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        std::size_t padding = alignmentPadding(alignment);
+
+        if (m_pCurrent == nullptr || padding + size > m_available) {
+            grow(size + alignment);
+            padding = alignmentPadding(alignment);
+        }
+
+        void *pMemory = m_pCurrent + padding;
+        m_pCurrent += padding + size;
+        m_available -= padding + size;
+        m_allocated += size;
+        return pMemory;
+    }
+
+    /// Total number of bytes allocated.
+    std::size_t allocated() const { return m_allocated; }
+
+private:
+    Arena(const Arena&) = delete;
+    Arena& operator =(const Arena&) = delete;
+
+    std::size_t alignmentPadding(std::size_t alignment) const
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(m_pCurrent);
+        return (alignment - address % alignment) % alignment;
     }
 
-private:
-    std::default_random_engine m_randomEngine;
-    std::uniform_real_distribution<> m_distribution;
+    void grow(std::size_t size)
+    {
+        const std::size_t chunkSize = std::max(size, m_chunkSize);
+        m_chunks.emplace_back(new char[chunkSize]);
+        m_pCurrent = m_chunks.back().get();
+        m_available = chunkSize;
+    }
+
+    std::vector<std::unique_ptr<char[]> > m_chunks;
+    char *m_pCurrent;
+    std::size_t m_available;
+    std::size_t m_chunkSize;
+    std::size_t m_allocated;
 };
 
 /**
- * @brief Input sign change node.
+ * @brief Bounded queue of commands posted to the graph by other threads.
+ * Any number of threads can push commands without locking, while the
+ * evaluating thread pops them. Commands are copied by value, so pushing
+ * never allocates.
  */
-template <typename T>
-class Neg : public Node,
-            public Inputs<T>,
-            public Outputs<T>
+class CommandQueue
 {
 public:
 
-    Neg(Graph &g)
-        : Node(g)
-    {}
+    static constexpr std::size_t PayloadSize = 16;
 
-    void evaluate() override
+    struct Command
     {
-        Outputs<T>::firstOutput() = -Inputs<T, T>::firstInput().value();
-    }
-};
+        /// Apply the value to the target at the given frame of the current block.
+        void (*apply)(void *pTarget, const void *pValue, std::size_t frame);
+        void *pTarget;
+        std::size_t frame;
+        typename std::aligned_storage<PayloadSize, alignof(std::max_align_t)>::type value;
+    };
 
-/**
- * @brief Add two values.
- */
-template <typename T>
-class Add : public Node,
-            public Inputs<T, T>,
-            public Outputs<T>
-{
-public:
+    explicit CommandQueue(std::size_t capacity);
 
-    Add(Graph &g)
-        : Node(g)
-    {}
+    /// Push a command, returns false if the queue is full.
+    bool push(const Command &command);
 
-    void evaluate() override
-    {
-        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
-            + Inputs<T, T>::otherInputs().firstInput().value();
-    }
-};
+    /// Pop the oldest command, only called by the evaluating thread.
+    bool pop(Command &command);
 
-/**
- * @brief Subtract two values.
- */
-template <typename T>
-class Sub : public Node,
-            public Inputs<T, T>,
-            public Outputs<T>
-{
-public:
+    std::size_t capacity() const { return m_mask + 1; }
 
-    Sub(Graph &g)
-        : Node(g)
-    {}
+private:
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator =(const CommandQueue&) = delete;
 
-    void evaluate() override
+    struct Slot
     {
-        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
-            - Inputs<T, T>::otherInputs().firstInput().value();
-    }
+        std::atomic<std::size_t> sequence;
+        Command command;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::size_t m_mask;
+
+    // Positions are kept on separate cache lines
+    char m_padding0[64];
+    std::atomic<std::size_t> m_head;
+    char m_padding1[64];
+    std::atomic<std::size_t> m_tail;
 };
 
 /**
- * @brief Multiply two values.
+ * @brief Graph evaluation strategy.
+ * Executors evaluate the groups of a prepared graph, respecting the
+ * dependencies between them. By default the graph evaluates its groups
+ * sequentially on the calling thread.
  */
-template <typename T>
-class Mul : public Node,
-            public Inputs<T, T>,
-            public Outputs<T>
+class Executor
 {
 public:
 
-    Mul(Graph &g)
-        : Node(g)
-    {}
+    virtual ~Executor() {}
 
-    void evaluate() override
-    {
-        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
-            * Inputs<T, T>::otherInputs().firstInput().value();
-    }
+    /**
+     * @brief Evaluate the graph.
+     * @param frames Number of frames in the block, or zero when
+     *               evaluating a single frame.
+     */
+    virtual void evaluate(Graph &g, std::size_t frames) = 0;
 };
 
 /**
- * @brief Divide two values.
+ * @brief Receiver of the graph evaluation times.
+ * The monitor is called on the evaluating thread after each evaluation,
+ * so it must neither block nor allocate.
  */
-template <typename T>
-class Div : public Node,
-            public Inputs<T, T>,
-            public Outputs<T>
+class Monitor
 {
 public:
 
-    Div(Graph &g)
-        : Node(g)
-    {}
+    virtual ~Monitor() {}
 
-    void evaluate() override
-    {
-        Outputs<T>::firstOutput() = Inputs<T, T>::firstInput().value()
-            / Inputs<T, T>::otherInputs().firstInput().value();
-    }
+    /**
+     * @brief Graph evaluation completed.
+     * @param frames Number of frames in the block, or zero for a single frame.
+     * @param elapsed Time taken by the evaluation.
+     */
+    virtual void evaluated(const Graph &g, std::size_t frames, std::chrono::nanoseconds elapsed) = 0;
 };
 
-} // namespace node
-//----------------------------------------------------------
-
 /**
  * @brief Dataflow graph.
+ *
+ * Before the first evaluation the graph gets prepared: the nodes are
+ * sorted according to the connections between them, so that each node
+ * is evaluated after all the nodes it depends on. Connections closing
+ * a feedback loop are treated as one-sample delays: the input reads the
+ * value its source produced on the previous tick. Within a loop the nodes
+ * keep the order they were created in. The evaluation order is cached and
+ * recomputed only when the connections change.
+ *
+ * The graph can be evaluated one frame at a time, or in blocks of frames.
+ * In the block mode each node processes the whole block at once, except for
+ * the nodes forming feedback loops, which are evaluated frame by frame.
+ *
+ * Nodes depending only on constant variables are evaluated once, when the
+ * graph gets prepared. With pruning enabled, only the nodes contributing to
+ * the observed outputs (or nodes without outputs) are evaluated.
+ *
+ * In incremental mode, evaluating a single frame only evaluates the nodes
+ * whose inputs have changed (see Graph::incremental()).
+ *
+ * When fusion is enabled, chains of built-in elementwise nodes get computed
+ * by a single node. The outputs in the middle of a fused chain are not updated
+ * any more, unless they are marked as observed (see OutputPort::observe()).
+ *
+ * With sharing enabled, outputs whose blocks are not needed at the same time
+ * store them in the same memory (see Graph::sharing()).
  */
 class Graph
 {
 public:
 
+    /**
+     * @brief Group of nodes evaluated together.
+     * This is either a single node, or nodes forming a feedback loop.
+     * Groups are listed in the evaluation order, a group only depends
+     * on the groups listed before it.
+     */
+    struct Group
+    {
+        std::size_t begin;  ///< First node index in the evaluation order.
+        std::size_t end;    ///< End of the nodes range.
+        bool feedback;      ///< Nodes must be evaluated frame by frame.
+
+        /// Groups that depend on this one.
+        std::vector<std::size_t> successors;
+
+        /// Number of groups this one depends on.
+        std::size_t dependencies;
+    };
+
     Graph()
-        : m_evaluationTimeStep(1e-6)
+        : m_arena(),
+          m_nodes(),
+          m_evaluationTimeStep(1e-6),
+          m_blockSize(0),
+          m_decoupledLatency(std::size_t(-1)),
+          m_pruning(false),
+          m_fusion(false),
+          m_sharing(false),
+          m_incremental(false),
+          m_prepared(false),
+          m_revision(0),
+          m_frame(0),
+          m_pExecutor(),
+          m_pMonitor(nullptr),
+          m_pCommands(new CommandQueue(DefaultCommandCapacity)),
+          m_deferred(),
+          m_sharedStorage(),
+          m_storageSize(0)
     {
+        m_deferred.reserve(DefaultCommandCapacity);
     }
 
+    ~Graph();
+
     double timeStep() const { return m_evaluationTimeStep; }
     void timeStep(double dt) { m_evaluationTimeStep = dt; }
 
     double sampleRate() const { return 1.0 / m_evaluationTimeStep; }
     void sampleRate(double sr) { m_evaluationTimeStep = 1.0 / sr; }
 
-    template <class N>
-    N& node()
+    /// Maximal number of frames in a block.
+    std::size_t blockSize() const { return m_blockSize; }
+
+    /**
+     * @brief Allocate ports storage for blocks of given size.
+     * Evaluating a larger block grows the storage automatically,
+     * setting the block size upfront keeps the allocations
+     * out of the processing loop.
+     */
+    void blockSize(std::size_t frames);
+
+    template <class N, typename... Args>
+    N& node(Args&&... args)
+    {
+        void *pMemory = m_arena.allocate(sizeof(N), alignof(N));
+        N *pNode = new (pMemory) N(*this, std::forward<Args>(args)...);
+        attachPorts(*pNode);
+        registerNode(pNode);
+        return *pNode;
+    }
+
+    /**
+     * @brief Compute the evaluation order.
+     * This is done automatically on evaluation whenever the graph
+     * has been modified.
+     */
+    void prepare();
+
+    /// Nodes in the creation order.
+    const std::vector<Node*>& nodes() const { return m_nodes; }
+
+    /// Nodes in the order they get evaluated.
+    const std::vector<Node*>& evaluationOrder()
+    {
+        if (!m_prepared)
+            prepare();
+        return m_order;
+    }
+
+    /// Groups of nodes, valid once the graph is prepared.
+    const std::vector<Group>& groups() const { return m_groups; }
+
+    /// Incremented each time the graph gets prepared.
+    std::size_t revision() const { return m_revision; }
+
+    /**
+     * @brief Frames evaluated so far.
+     * Nodes are evaluated on the frames multiple of their rate divisor.
+     */
+    std::uint64_t frame() const { return m_frame; }
+    void frame(std::uint64_t f) { m_frame = f; }
+
+    /**
+     * @brief Assign the evaluation strategy.
+     * Passing nullptr restores the default sequential evaluation.
+     */
+    void executor(std::unique_ptr<Executor> executor)
+    {
+        m_pExecutor = std::move(executor);
+
+        // Blocks are shared according to the sequential evaluation order
+        if (m_sharing)
+            invalidate();
+    }
+    Executor* executor() const { return m_pExecutor.get(); }
+
+    static constexpr std::size_t DefaultCommandCapacity = 256;
+
+    /**
+     * @brief Resize the commands queue.
+     * This must not run concurrently with posting the commands.
+     */
+    void commandCapacity(std::size_t capacity)
+    {
+        m_pCommands.reset(new CommandQueue(capacity));
+        m_deferred.reserve(m_pCommands->capacity());
+    }
+
+    /**
+     * @brief Post a variable assignment from any thread.
+     * The value gets assigned when the next evaluation starts, without locking.
+     * @param frame Frame of the next block at which the value changes. Commands
+     *              beyond the next block are kept for the following ones, when
+     *              evaluating single frames this is the number of ticks to wait.
+     * @return false if the queue is full.
+     */
+    template <typename T>
+    bool post(node::Variable<T> &variable, const T &value, std::size_t frame = 0)
+    {
+        return postCommand(&applyVariable<T>, &variable, value, frame);
+    }
+
+    /**
+     * @brief Post an input value change from any thread.
+     * Input values change at the beginning of the block containing the frame.
+     */
+    template <typename T>
+    bool post(Input<T> &input, const T &value, std::size_t frame = 0)
     {
-        auto nodePtr = std::make_shared<N>(*this);
-        registerNode(nodePtr);
-        return *nodePtr.get();
+        return postCommand(&applyInput<T>, &input, value, frame);
     }
 
+    /**
+     * @brief Assign a monitor receiving the evaluation times.
+     * The monitor is not owned by the graph, nullptr removes it.
+     */
+    void monitor(Monitor *pMonitor) { m_pMonitor = pMonitor; }
+    Monitor* monitor() const { return m_pMonitor; }
+
     void evaluate()
     {
-        // Evaluate all the nodes
-        for (auto &n : m_nodes) {
-            n->evaluate();
+        applyCommands(1);
+
+        if (!m_prepared)
+            prepare();
+
+        if (m_pMonitor == nullptr) {
+            evaluateTick();
+        } else {
+            const auto start = std::chrono::steady_clock::now();
+            evaluateTick();
+            m_pMonitor->evaluated(*this, 0, std::chrono::steady_clock::now() - start);
         }
+
+        ++m_frame;
+    }
+
+    /// Evaluate a block of frames.
+    void evaluate(std::size_t frames);
+
+    /**
+     * @brief Evaluate a single group of nodes.
+     * This is meant to be used by executors.
+     * @param index Group index.
+     * @param frames Number of frames to process, or zero to evaluate a single frame.
+     */
+    void evaluateGroup(std::size_t index, std::size_t frames);
+
+    /// Mark the graph as modified, so it gets prepared again.
+    void invalidate() { m_prepared = false; }
+
+    /// Whether the graph is prepared and not modified since.
+    bool prepared() const { return m_prepared; }
+
+    /**
+     * @brief Enable the dead nodes elimination.
+     * Outputs read from outside the graph must then be marked as observed,
+     * nodes neither of them depends on are not evaluated. Nodes without
+     * outputs are always evaluated.
+     */
+    void pruning(bool enabled)
+    {
+        m_pruning = enabled;
+        invalidate();
+    }
+
+    bool pruning() const { return m_pruning; }
+
+    /**
+     * @brief Enable fusion of elementwise nodes.
+     * Chains of built-in arithmetic nodes whose intermediate outputs are
+     * connected to a single input and not observed are evaluated by a single node.
+     */
+    void fusion(bool enabled)
+    {
+        m_fusion = enabled;
+        invalidate();
+    }
+
+    bool fusion() const { return m_fusion; }
+
+    /**
+     * @brief Enable sharing the outputs block storage.
+     * When the graph gets prepared, the lifetime of each output block is
+     * computed, from the evaluation of its node to that of its last reader,
+     * and blocks whose lifetimes do not overlap get the same memory. This
+     * keeps large graphs in cache, but the blocks of outputs which are not
+     * observed are then overwritten during the evaluation. Observed outputs,
+     * outputs of constant nodes and of types that are not trivially copyable
+     * keep their own storage, as do all the outputs when an executor is used.
+     */
+    void sharing(bool enabled)
+    {
+        m_sharing = enabled;
+        invalidate();
+    }
+
+    bool sharing() const { return m_sharing; }
+
+    /// Bytes of the outputs block storage, shared or not.
+    std::size_t storageSize() const { return m_storageSize; }
+
+    /**
+     * @brief Enable the incremental evaluation.
+     * When evaluating a single frame, only the nodes marked dirty and the
+     * nodes depending on them get evaluated. Assigning a variable or an input
+     * marks its node dirty, nodes that are alwaysDirty() are evaluated on each
+     * tick as well as the feedback loops. Blocks are always evaluated entirely.
+     * The executor is not used for the incremental evaluation.
+     */
+    void incremental(bool enabled)
+    {
+        m_incremental = enabled;
+        invalidate();
+    }
+
+    bool incremental() const { return m_incremental; }
+
+#if DF_PROFILING
+    /// Evaluation statistics, available when compiled with DF_PROFILING.
+    Stats& stats() { return m_stats; }
+    const Stats& stats() const { return m_stats; }
+#endif
+
+    /// Evaluate the node on the next tick, in incremental mode.
+    void markDirty(const Node &node)
+    {
+        if (m_incremental && m_prepared && node.m_index < m_positions.size())
+            markDirty(m_positions[node.m_index]);
     }
 
+    /**
+     * @brief Copy the state of the graph to a buffer.
+     * That is the frame counter, the nodes state (see Node::stateSize()), the
+     * outputs values and the inputs default values, one after another. The
+     * buffer is only reallocated when the state grows, so that checkpoints
+     * can be taken repeatedly without allocating.
+     */
+    void snapshot(std::vector<char> &data) const;
+
+    /**
+     * @brief Restore the state copied by snapshot().
+     * Only the values of trivially copyable types are restored.
+     * @return false if the data does not match the graph nodes. The graph is
+     *         left as it was when the layout of the data differs, but a node
+     *         rejecting its state stops the restoration there.
+     */
+    bool restore(const void *pData, std::size_t size);
+    bool restore(const std::vector<char> &data) { return restore(data.data(), data.size()); }
+
     // Default nodes
 
     template <typename T>
@@ -456,9 +3032,49 @@ public:
     template <typename T>
     node::WhiteNoise<T>& noise(const T min = 0, const T max = 1)
     {
-        auto nodePtr = std::make_shared<node::WhiteNoise<T> >(*this, min, max);
-        registerNode(nodePtr);
-        return *nodePtr.get();
+        return Graph::node<node::WhiteNoise<T> >(min, max);
+    }
+
+    template <typename T>
+    node::Ramp<T>& ramp(const T &value = T())
+    {
+        return Graph::node<node::Ramp<T> >(value);
+    }
+
+    template <typename T>
+    node::Smoother<T>& smoother(double seconds = 0.01)
+    {
+        return Graph::node<node::Smoother<T> >(seconds);
+    }
+
+    template <typename T>
+    node::Automation<T>& automation()
+    {
+        return Graph::node<node::Automation<T> >();
+    }
+
+    template <typename T>
+    node::Interpolator<T>& interpolator()
+    {
+        return Graph::node<node::Interpolator<T> >();
+    }
+
+    template <typename T>
+    node::Delay<T>& delay(std::size_t length = 1)
+    {
+        return Graph::node<node::Delay<T> >(length);
+    }
+
+    template <typename T>
+    node::Source<T>& source()
+    {
+        return Graph::node<node::Source<T> >();
+    }
+
+    template <typename T>
+    node::Sink<T>& sink()
+    {
+        return Graph::node<node::Sink<T> >();
     }
 
     template <typename T>
@@ -491,20 +3107,288 @@ public:
         return Graph::node<node::Div<T> >();
     }
 
+    template <typename T>
+    node::Sum<T>& sum(std::size_t inputs = 2)
+    {
+        return Graph::node<node::Sum<T> >(inputs);
+    }
+
+    template <typename T>
+    node::Product<T>& product(std::size_t inputs = 2)
+    {
+        return Graph::node<node::Product<T> >(inputs);
+    }
+
+    template <typename T>
+    node::Mix<T>& mix(std::size_t inputs = 2)
+    {
+        return Graph::node<node::Mix<T> >(inputs);
+    }
+
+    template <typename From, typename To>
+    node::Convert<From, To>& convert()
+    {
+        return Graph::node<node::Convert<From, To> >();
+    }
+
 private:
     Graph(const Graph&) = delete;
     Graph& operator =(const Graph&) = delete;
 
-    void registerNode(Node::Ptr node)
+    template <class... Ns> friend class df::StaticGraph;
+
+    // Collect the node ports and make them refer to the node.
+    template <class N>
+    static void attachPorts(N &n)
+    {
+        collectInputs(n, 0);
+        collectOutputs(n, 0);
+
+        for (auto *port : n.m_inputs)
+            port->m_pNode = &n;
+        for (auto *port : n.m_outputs)
+            port->m_pNode = &n;
+    }
+
+    // Ports collection, for nodes having input and/or output lists.
+    template <class N>
+    static auto collectInputs(N &n, int) -> decltype(n.listInputs(n.m_inputs), void())
+    {
+        n.listInputs(n.m_inputs);
+    }
+
+    template <class N>
+    static void collectInputs(N&, long) {}
+
+    template <class N>
+    static auto collectOutputs(N &n, int) -> decltype(n.listOutputs(n.m_outputs), void())
+    {
+        n.listOutputs(n.m_outputs);
+    }
+
+    template <class N>
+    static void collectOutputs(N&, long) {}
+
+    void registerNode(Node *pNode);
+
+    // Node producing the value of an input, if it belongs to this graph.
+    Node* sourceNode(const InputPort *input) const;
+
+    // Remove the constant and dead nodes from the evaluation order.
+    void simplify();
+
+    // Replace chains of elementwise nodes by fused ones.
+    void fuse();
+
+    // Compute the dependencies between the groups.
+    void connectGroups();
+
+    // Build the dependencies for the incremental evaluation.
+    void trackChanges();
+
+    void markDirty(std::size_t position)
+    {
+        if (position < m_dirty.size() && !m_dirty[position]) {
+            m_dirty[position] = true;
+            m_pending.push_back(position);
+            std::push_heap(m_pending.begin(), m_pending.end(), std::greater<std::size_t>());
+        }
+    }
+
+    template <typename T>
+    bool postCommand(void (*apply)(void*, const void*, std::size_t), void *pTarget,
+                     const T &value, std::size_t frame)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= CommandQueue::PayloadSize,
+                      "Values posted to the graph must be small trivially copyable types");
+
+        CommandQueue::Command command;
+        command.apply = apply;
+        command.pTarget = pTarget;
+        command.frame = frame;
+        std::memcpy(&command.value, &value, sizeof(T));
+        return m_pCommands->push(command);
+    }
+
+    template <typename T>
+    static void applyVariable(void *pTarget, const void *pValue, std::size_t frame)
+    {
+        static_cast<node::Variable<T>*>(pTarget)->schedule(frame, *static_cast<const T*>(pValue));
+    }
+
+    template <typename T>
+    static void applyInput(void *pTarget, const void *pValue, std::size_t)
+    {
+        *static_cast<Input<T>*>(pTarget) = *static_cast<const T*>(pValue);
+    }
+
+    // Apply the commands due within the next frames.
+    void applyCommands(std::size_t frames);
+
+    // Evaluate the prepared graph.
+    void evaluateTick()
+    {
+#if DF_PROFILING
+        Stats::Scope scope(m_stats, 0);
+#endif
+
+        if (m_incremental) {
+            evaluateDirty();
+        } else if (m_pExecutor) {
+            m_pExecutor->evaluate(*this, 0);
+        } else {
+            // Evaluate all the nodes
+            for (auto *n : m_order) {
+                if (due(n, 0))
+                    evaluateNode(n);
+            }
+        }
+
+        for (auto *n : m_decoupledNodes)
+            n->consume(0);
+        for (auto *n : m_loopDecoupledNodes)
+            n->consume(0);
+    }
+
+    // Whether the node is evaluated on the given frame of the current block.
+    bool due(const Node *pNode, std::size_t frame) const
+    {
+        return pNode->m_rateDivisor == 1 || (m_frame + frame) % pNode->m_rateDivisor == 0;
+    }
+
+    // First frame of the current block the node gets evaluated on.
+    std::size_t firstDue(const Node *pNode) const
+    {
+        const std::size_t phase = std::size_t(m_frame % pNode->m_rateDivisor);
+        return phase == 0 ? 0 : pNode->m_rateDivisor - phase;
+    }
+
+    void evaluateBlock(std::size_t frames);
+
+    // Evaluate the dirty nodes, in the evaluation order.
+    void evaluateDirty();
+
+    // Nodes evaluation, measured when profiling.
+    void evaluateNode(Node *pNode)
+    {
+#if DF_PROFILING
+        const std::uint64_t begin = profile::now();
+        pNode->evaluate();
+        m_stats.record(pNode->m_index, begin, profile::now(), 0);
+#else
+        pNode->evaluate();
+#endif
+    }
+
+    void evaluateNodeFrame(Node *pNode, std::size_t frame)
+    {
+#if DF_PROFILING
+        const std::uint64_t begin = profile::now();
+        pNode->evaluateFrame(frame);
+        m_stats.record(pNode->m_index, begin, profile::now(), 0);
+#else
+        pNode->evaluateFrame(frame);
+#endif
+    }
+
+    void processNode(Node *pNode, std::size_t frames)
     {
-        m_nodes.push_back(node);
+#if DF_PROFILING
+        const std::uint64_t begin = profile::now();
+#endif
+
+        if (pNode->m_rateDivisor == 1)
+            pNode->process(frames);
+        else
+            pNode->processDivided(frames, firstDue(pNode));
+
+#if DF_PROFILING
+        m_stats.record(pNode->m_index, begin, profile::now(), frames);
+#endif
     }
 
-    std::vector<Node::Ptr> m_nodes;
+    // Allocate ports storage according to the block size.
+    void reserve();
+
+    // Assign the shared storage to the outputs, see sharing().
+    void share();
+
+    // Storage of the nodes, owned exclusively by the graph.
+    Arena m_arena;
+
+    // Nodes in the creation order.
+    std::vector<Node*> m_nodes;
+
+    // Cached evaluation order.
+    std::vector<Node*> m_order;
+    std::vector<Group> m_groups;
+
+    // Nodes computed once, in the evaluation order.
+    std::vector<Node*> m_constantNodes;
+
+    // Nodes consuming their inputs after the evaluation of each block,
+    // and within loops after each frame, see Node::latency().
+    std::vector<Node*> m_decoupledNodes;
+    std::vector<Node*> m_loopDecoupledNodes;
+
+    // Nodes created by the optimizations.
+    std::vector<std::unique_ptr<Node> > m_fusedNodes;
+
+    // Incremental evaluation state: evaluation order position of each
+    // node, nodes depending on each position, the positions evaluated
+    // on each tick, and a min-heap of the dirty positions.
+    std::vector<std::size_t> m_positions;
+    std::vector<std::vector<std::size_t> > m_dependents;
+    std::vector<std::size_t> m_alwaysDirty;
+    std::vector<bool> m_dirty;
+    std::vector<std::size_t> m_pending;
 
     double m_evaluationTimeStep;
+
+    std::size_t m_blockSize;
+
+    // Shortest latency of the decoupled nodes, larger blocks prepare again.
+    std::size_t m_decoupledLatency;
+
+    bool m_pruning;
+    bool m_fusion;
+    bool m_sharing;
+    bool m_incremental;
+
+    bool m_prepared;
+
+    std::size_t m_revision;
+
+    // Frames evaluated so far.
+    std::uint64_t m_frame;
+
+    std::unique_ptr<Executor> m_pExecutor;
+
+    Monitor *m_pMonitor;
+
+    // Commands posted by other threads, and the ones due in later blocks.
+    std::unique_ptr<CommandQueue> m_pCommands;
+    std::vector<CommandQueue::Command> m_deferred;
+
+    // Memory of the shared output blocks, and the total storage.
+    std::vector<char> m_sharedStorage;
+    std::size_t m_storageSize;
+
+#if DF_PROFILING
+    Stats m_stats;
+#endif
 };
 
+template <typename T>
+template <typename U>
+Output<T>& Output<T>::operator >>(Input<U> &input)
+{
+    auto &convert = node()->graph().template convert<T, U>();
+    connect(convert.template in<0>());
+    convert.template out<0>() >> input;
+    return *this;
+}
+
 } // namespace df
 
 #endif // DF_H_INCLUDED
@@ -0,0 +1,118 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include "df_async.h"
+
+namespace df {
+
+AsyncTask::AsyncTask(AsyncPool &pool, Run run)
+    : m_pool(pool),
+      m_pRun(run),
+      m_scheduled(false),
+      m_again(false)
+{
+}
+
+AsyncTask::~AsyncTask()
+{
+}
+
+void AsyncTask::schedule()
+{
+    m_pool.schedule(this);
+}
+
+void AsyncTask::wait()
+{
+    m_pool.wait(this);
+}
+
+//----------------------------------------------------------
+
+AsyncPool::AsyncPool(std::size_t threads)
+    : m_queue(),
+      m_mutex(),
+      m_wakeUp(),
+      m_done(),
+      m_stop(false),
+      m_threads()
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+        m_threads.emplace_back(&AsyncPool::work, this);
+}
+
+AsyncPool::~AsyncPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_wakeUp.notify_all();
+    for (auto &thread : m_threads)
+        thread.join();
+}
+
+void AsyncPool::schedule(AsyncTask *pTask)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (pTask->m_scheduled) {
+        pTask->m_again = true;
+    } else {
+        pTask->m_scheduled = true;
+        m_queue.push_back(pTask);
+        m_wakeUp.notify_one();
+    }
+}
+
+void AsyncPool::wait(AsyncTask *pTask)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [pTask]() { return !pTask->m_scheduled; });
+}
+
+void AsyncPool::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_wakeUp.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+
+        // The tasks queued are done before stopping
+        if (m_queue.empty())
+            return;
+
+        AsyncTask *pTask = m_queue.front();
+        m_queue.pop_front();
+
+        lock.unlock();
+        pTask->m_pRun(pTask);
+        lock.lock();
+
+        if (pTask->m_again) {
+            pTask->m_again = false;
+            m_queue.push_back(pTask);
+        } else {
+            // The task may get destroyed as soon as it is released
+            pTask->m_scheduled = false;
+            m_done.notify_all();
+        }
+    }
+}
+
+} // namespace df
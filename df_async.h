@@ -0,0 +1,351 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_ASYNC_H_INCLUDED
+#define DF_ASYNC_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+class AsyncPool;
+
+/**
+ * @brief Work done in the background by a pool thread.
+ * A task scheduled while it runs gets run again afterwards, never
+ * on two threads at once. Derived classes must wait() for the task
+ * in their destructor, before the members it uses get destroyed.
+ * The work is a plain function rather than a virtual method, whose
+ * call would race with the destruction.
+ */
+class AsyncTask
+{
+protected:
+
+    friend class AsyncPool;
+
+    // Do the work submitted so far, called by a pool thread.
+    using Run = void (*)(AsyncTask *pTask);
+
+    AsyncTask(AsyncPool &pool, Run run);
+    ~AsyncTask();
+
+    // Make the pool run the task.
+    void schedule();
+
+    // Wait for the task to have done all the work scheduled.
+    void wait();
+
+private:
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator =(const AsyncTask&) = delete;
+
+    AsyncPool &m_pool;
+    Run m_pRun;
+
+    // Whether the task is queued or running, and scheduled again while running.
+    // These are guarded by the pool lock.
+    bool m_scheduled;
+    bool m_again;
+};
+
+/**
+ * @brief Threads running the asynchronous nodes jobs.
+ * The pool must outlive the nodes using it.
+ */
+class AsyncPool
+{
+public:
+
+    explicit AsyncPool(std::size_t threads = 1);
+    ~AsyncPool();
+
+    std::size_t size() const { return m_threads.size(); }
+
+private:
+    AsyncPool(const AsyncPool&) = delete;
+    AsyncPool& operator =(const AsyncPool&) = delete;
+
+    friend class AsyncTask;
+
+    void schedule(AsyncTask *pTask);
+    void wait(AsyncTask *pTask);
+
+    void work();
+
+    std::deque<AsyncTask*> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+    bool m_stop;
+
+    std::vector<std::thread> m_threads;
+};
+
+namespace node {
+
+/**
+ * @brief Node computing its output in the background.
+ *
+ * The job, which a pool thread calls on the input frames in order, possibly
+ * several blocks (or ticks) at once or a block in two parts, must not access
+ * the graph. It is a member of the node, so that the node can wait for it to
+ * be done before getting destroyed.
+ *
+ * The output lags behind the input of the given latency, the first frames
+ * being default values. A latency of at least the block size decouples the
+ * node (see Node::latency()): the input of a block is submitted once the block
+ * has been evaluated, and gets computed while the graph evaluates the next
+ * ones. The evaluation only waits when the result is not ready by the time it
+ * is due, which counts as a stall. With a shorter latency, the evaluation
+ * waits for each block to be computed.
+ *
+ * @code
+ * df::AsyncPool pool;
+ * auto &lookup = g.node<df::node::Async<int, float> >(pool, 1024,
+ *     [&database](const int *keys, float *values, std::size_t frames) {
+ *         for (std::size_t i = 0; i < frames; ++i)
+ *             values[i] = database.find(keys[i]);
+ *     });
+ * @endcode
+ */
+template <typename In, typename Out = In>
+class Async : public Node,
+              public Inputs<In>,
+              public Outputs<Out>,
+              private AsyncTask
+{
+public:
+
+    /// Compute the output frames of the input ones.
+    using Job = std::function<void(const In *pIn, Out *pOut, std::size_t frames)>;
+
+    Async(Graph &g, AsyncPool &pool, std::size_t latency, Job job)
+        : Node(g),
+          AsyncTask(pool, &Async::run),
+          m_job(std::move(job)),
+          m_latency(latency),
+          m_reserved(1),
+          m_frames(),
+          m_results(),
+          m_mask(0),
+          m_submitted(0),
+          m_computed(0),
+          m_emitted(0),
+          m_stalls(0),
+          m_mutex(),
+          m_ready()
+    {
+        restart();
+    }
+
+    ~Async() override
+    {
+        AsyncTask::wait();
+    }
+
+    std::size_t latency() const override { return m_latency; }
+
+    /// Change the latency, which restarts the computation from default values.
+    void latency(std::size_t frames)
+    {
+        AsyncTask::wait();
+        m_latency = frames;
+        restart();
+        invalidateGraph();
+    }
+
+    /// Number of times the evaluation waited for a result.
+    std::size_t stalls() const { return m_stalls; }
+
+    void reserve(std::size_t frames) override
+    {
+        m_reserved = std::max<std::size_t>(frames, 1);
+        if (m_latency + m_reserved >= m_frames.size())
+            grow();
+    }
+
+    void evaluate() override
+    {
+        if (!decoupled())
+            submit(&Inputs<In>::firstInput().value(), 1);
+
+        Out value;
+        emit(&value, 1);
+        Outputs<Out>::firstOutput() = value;
+    }
+
+    void process(std::size_t frames) override
+    {
+        if (!decoupled())
+            submit(Inputs<In>::firstInput().block(), frames);
+
+        emit(Outputs<Out>::firstOutput().block(), frames);
+    }
+
+    void consume(std::size_t frames) override
+    {
+        if (frames == 0)
+            submit(&Inputs<In>::firstInput().value(), 1);
+        else
+            submit(Inputs<In>::firstInput().block(), frames);
+    }
+
+private:
+
+    static void run(AsyncTask *pTask)
+    {
+        static_cast<Async*>(pTask)->compute();
+    }
+
+    void compute()
+    {
+        const std::size_t submitted = m_submitted.load(std::memory_order_acquire);
+        std::size_t computed = m_computed.load(std::memory_order_relaxed);
+
+        while (computed < submitted) {
+            const std::size_t in = computed & m_mask;
+            const std::size_t out = (computed + m_latency) & m_mask;
+            const std::size_t frames = std::min(submitted - computed, m_frames.size() - std::max(in, out));
+
+            m_job(&m_frames[in], &m_results[out], frames);
+            computed += frames;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_computed.store(computed, std::memory_order_release);
+            }
+
+            m_ready.notify_one();
+        }
+    }
+
+    // Queue input frames for computing.
+    void submit(const In *pIn, std::size_t frames)
+    {
+        std::size_t position = m_submitted.load(std::memory_order_relaxed);
+        const std::size_t end = position + frames;
+
+        while (position < end) {
+            const std::size_t index = position & m_mask;
+            const std::size_t count = std::min(end - position, m_frames.size() - index);
+            std::copy(pIn, pIn + count, &m_frames[index]);
+            pIn += count;
+            position += count;
+        }
+
+        m_submitted.store(end, std::memory_order_release);
+        AsyncTask::schedule();
+    }
+
+    // Output computed frames, waiting for them if needed.
+    void emit(Out *pOut, std::size_t frames)
+    {
+        const std::size_t end = m_emitted + frames;
+
+        if (m_computed.load(std::memory_order_acquire) + m_latency < end) {
+            ++m_stalls;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [this, end]() {
+                return m_computed.load(std::memory_order_relaxed) + m_latency >= end;
+            });
+        }
+
+        while (m_emitted < end) {
+            const std::size_t index = m_emitted & m_mask;
+            const std::size_t count = std::min(end - m_emitted, m_results.size() - index);
+            std::copy(&m_results[index], &m_results[index] + count, pOut);
+            pOut += count;
+            m_emitted += count;
+        }
+    }
+
+    // Size of the rings, which hold the frames being computed and the outputs
+    // not emitted yet, as well as the block submitted or emitted.
+    std::size_t capacity() const
+    {
+        std::size_t size = 1;
+        while (size <= m_latency + m_reserved)
+            size <<= 1;
+
+        return size;
+    }
+
+    void restart()
+    {
+        const std::size_t size = capacity();
+        m_frames.assign(size, In());
+        m_results.assign(size, Out());
+        m_mask = size - 1;
+        m_submitted.store(0, std::memory_order_relaxed);
+        m_computed.store(0, std::memory_order_relaxed);
+        m_emitted = 0;
+    }
+
+    // Enlarge the rings, keeping the results that have not been emitted.
+    void grow()
+    {
+        AsyncTask::wait();
+
+        const std::size_t size = capacity();
+        const std::size_t computed = m_computed.load(std::memory_order_relaxed);
+        std::vector<Out> results(size, Out());
+
+        for (std::size_t i = m_emitted; i < computed + m_latency; ++i)
+            results[i & (size - 1)] = m_results[i & m_mask];
+
+        m_frames.assign(size, In());
+        m_results.swap(results);
+        m_mask = size - 1;
+    }
+
+    Job m_job;
+
+    std::size_t m_latency;
+    std::size_t m_reserved;
+
+    // Rings of the input frames and of the results, indexed by frame position.
+    // The result of a frame lands m_latency positions after it.
+    std::vector<In> m_frames;
+    std::vector<Out> m_results;
+    std::size_t m_mask;
+
+    // Frames submitted by the evaluation, computed by the pool, and emitted.
+    std::atomic<std::size_t> m_submitted;
+    std::atomic<std::size_t> m_computed;
+    std::size_t m_emitted;
+
+    std::size_t m_stalls;
+
+    // Signals the results to a waiting evaluation.
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+};
+
+} // namespace node
+
+} // namespace df
+
+#endif // DF_ASYNC_H_INCLUDED
@@ -0,0 +1,138 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include "df_deadline.h"
+
+namespace df {
+
+namespace {
+
+// Index of the most significant bit set, value must not be zero.
+std::size_t highestBit(std::uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - std::size_t(__builtin_clzll(value));
+#else
+    std::size_t bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+#endif
+}
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram()
+    : m_count(0),
+      m_max(0)
+{
+    reset();
+}
+
+std::size_t LatencyHistogram::bucket(std::uint64_t value)
+{
+    // Values below SubBuckets have a bucket each, then each
+    // power of two is split into SubBuckets linear buckets.
+    if (value < SubBuckets)
+        return std::size_t(value);
+
+    const std::size_t bit = highestBit(value);
+    const std::size_t shift = bit - 3;
+    return (bit - 2) * SubBuckets + std::size_t((value >> shift) & (SubBuckets - 1));
+}
+
+std::uint64_t LatencyHistogram::upperBound(std::size_t bucket)
+{
+    if (bucket < SubBuckets)
+        return bucket;
+
+    const std::size_t shift = bucket / SubBuckets - 1;
+    const std::uint64_t lower = std::uint64_t(SubBuckets + bucket % SubBuckets) << shift;
+    return lower + (std::uint64_t(1) << shift) - 1;
+}
+
+std::uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    const std::uint64_t total = count();
+    if (total == 0)
+        return 0;
+
+    // Rank of the value, counted from one
+    std::uint64_t rank = std::uint64_t(fraction * double(total) + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < Buckets; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(upperBound(i), max());
+    }
+
+    return max();
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------
+
+DeadlineMonitor::DeadlineMonitor(double load)
+    : m_load(load),
+      m_callback(),
+      m_overruns(0),
+      m_histogram()
+{
+}
+
+void DeadlineMonitor::evaluated(const Graph &g, std::size_t frames, std::chrono::nanoseconds elapsed)
+{
+    m_histogram.record(std::uint64_t(elapsed.count()));
+
+    const double seconds = double(frames == 0 ? 1 : frames) * g.timeStep() * m_load;
+    const std::chrono::nanoseconds budget(std::int64_t(seconds * 1e9));
+
+    if (elapsed > budget) {
+        m_overruns.fetch_add(1, std::memory_order_relaxed);
+        if (m_callback)
+            m_callback(Overrun { frames, elapsed, budget });
+    }
+}
+
+DeadlineMonitor::Latency DeadlineMonitor::latency() const
+{
+    return Latency { m_histogram.percentile(0.5),
+                     m_histogram.percentile(0.99),
+                     m_histogram.percentile(0.999),
+                     m_histogram.max() };
+}
+
+void DeadlineMonitor::reset()
+{
+    m_overruns.store(0, std::memory_order_relaxed);
+    m_histogram.reset();
+}
+
+} // namespace df
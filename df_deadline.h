@@ -0,0 +1,144 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_DEADLINE_H_INCLUDED
+#define DF_DEADLINE_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Histogram of durations, updated without locking.
+ * Buckets grow exponentially, each power of two being split into
+ * eight buckets, so that a value is known within 12.5%. Values can be
+ * recorded on one thread while being read from another.
+ */
+class LatencyHistogram
+{
+public:
+
+    static constexpr std::size_t SubBuckets = 8;
+    static constexpr std::size_t Buckets = 62 * SubBuckets;
+
+    LatencyHistogram();
+
+    void record(std::uint64_t ns)
+    {
+        m_buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        std::uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    /// Number of recorded values.
+    std::uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    /// Largest recorded value, in nanoseconds.
+    std::uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Value below which the given fraction of the values fall.
+     * @param fraction Fraction in [0, 1] range, 0.99 for the 99th percentile.
+     * @return Upper bound of the bucket, in nanoseconds.
+     */
+    std::uint64_t percentile(double fraction) const;
+
+    void reset();
+
+    /// Index of the bucket holding the value.
+    static std::size_t bucket(std::uint64_t value);
+
+    /// Largest value held by the bucket.
+    static std::uint64_t upperBound(std::size_t bucket);
+
+private:
+
+    std::atomic<std::uint64_t> m_buckets[Buckets];
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::uint64_t> m_max;
+};
+
+/**
+ * @brief Monitor checking the graph evaluations against the real-time budget.
+ * An evaluation of N frames must complete within N / sampleRate seconds,
+ * scaled by the load factor. The overrun callback is called on the evaluating
+ * thread, so it must neither block nor allocate. The statistics can be read
+ * from any thread.
+ */
+class DeadlineMonitor : public Monitor
+{
+public:
+
+    /// Evaluation which did not fit its budget.
+    struct Overrun
+    {
+        std::size_t frames;                 ///< Frames in the block, zero for a single frame.
+        std::chrono::nanoseconds elapsed;   ///< Evaluation time.
+        std::chrono::nanoseconds budget;    ///< Time available.
+    };
+
+    using Callback = std::function<void(const Overrun&)>;
+
+    /// Latency percentiles, in nanoseconds.
+    struct Latency
+    {
+        std::uint64_t p50;
+        std::uint64_t p99;
+        std::uint64_t p999;
+        std::uint64_t max;
+    };
+
+    /**
+     * @param load Fraction of the real-time budget the graph evaluation may use.
+     */
+    explicit DeadlineMonitor(double load = 1.0);
+
+    double load() const { return m_load; }
+    void load(double l) { m_load = l; }
+
+    /// Set the function called on overruns, not thread-safe.
+    void onOverrun(Callback callback) { m_callback = std::move(callback); }
+
+    void evaluated(const Graph &g, std::size_t frames, std::chrono::nanoseconds elapsed) override;
+
+    /// Number of evaluations that exceeded their budget.
+    std::uint64_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+
+    /// Distribution of the evaluation times.
+    const LatencyHistogram& histogram() const { return m_histogram; }
+
+    Latency latency() const;
+
+    void reset();
+
+private:
+
+    double m_load;
+    Callback m_callback;
+    std::atomic<std::uint64_t> m_overruns;
+    LatencyHistogram m_histogram;
+};
+
+} // namespace df
+
+#endif // DF_DEADLINE_H_INCLUDED
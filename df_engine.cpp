@@ -0,0 +1,150 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include "df_engine.h"
+
+namespace df {
+
+Engine::Engine(std::unique_ptr<Graph> graph)
+    : m_pCurrent(nullptr),
+      m_pending(nullptr),
+      m_blockSize(0)
+{
+    for (auto &slot : m_retired)
+        slot.store(nullptr, std::memory_order_relaxed);
+
+    if (graph) {
+        m_pCurrent = new Slot();
+        m_pCurrent->graph = std::move(graph);
+    }
+}
+
+Engine::~Engine()
+{
+    collect();
+    delete m_pending.load();
+    delete m_pCurrent;
+}
+
+bool Engine::submit(std::unique_ptr<Graph> graph)
+{
+    // The running graph only changes while a graph is pending
+    if (pending())
+        return false;
+
+    std::unique_ptr<Slot> slot(new Slot());
+
+    graph->prepare();
+    const std::size_t frames = m_blockSize.load(std::memory_order_relaxed);
+    if (frames > graph->blockSize())
+        graph->blockSize(frames);
+
+    // Match the nodes by name, only reading the running graph
+    if (m_pCurrent != nullptr) {
+        std::unordered_map<std::string, const Node*> previous;
+        for (const Node *pNode : m_pCurrent->graph->nodes()) {
+            if (!pNode->name().empty())
+                previous.emplace(pNode->name(), pNode);
+        }
+
+        for (Node *pNode : graph->nodes()) {
+            if (pNode->name().empty())
+                continue;
+
+            const auto it = previous.find(pNode->name());
+            if (it != previous.end() && typeid(*it->second) == typeid(*pNode))
+                slot->transfers.emplace_back(pNode, it->second);
+        }
+    }
+
+    slot->graph = std::move(graph);
+    m_pending.store(slot.release(), std::memory_order_release);
+    return true;
+}
+
+void Engine::swap()
+{
+    Slot *pNext = m_pending.load(std::memory_order_acquire);
+    if (pNext == nullptr)
+        return;
+
+    // Keep running the current graph until there is room to retire it
+    std::atomic<Slot*> *pRetired = nullptr;
+    for (auto &slot : m_retired) {
+        if (slot.load(std::memory_order_acquire) == nullptr) {
+            pRetired = &slot;
+            break;
+        }
+    }
+
+    if (m_pCurrent != nullptr && pRetired == nullptr)
+        return;
+
+    for (const auto &transfer : pNext->transfers) {
+        const auto &from = transfer.second->outputs();
+        const auto &to = transfer.first->outputs();
+
+        for (std::size_t i = 0; i < from.size() && i < to.size(); ++i)
+            to[i]->copyValue(*from[i]);
+
+        transfer.first->inheritState(*transfer.second);
+    }
+
+    if (m_pCurrent != nullptr)
+        pRetired->store(m_pCurrent, std::memory_order_release);
+
+    m_pCurrent = pNext;
+    m_pending.store(nullptr, std::memory_order_release);
+}
+
+void Engine::evaluate()
+{
+    swap();
+
+    if (m_pCurrent != nullptr)
+        m_pCurrent->graph->evaluate();
+}
+
+void Engine::evaluate(std::size_t frames)
+{
+    swap();
+
+    if (frames > m_blockSize.load(std::memory_order_relaxed))
+        m_blockSize.store(frames, std::memory_order_relaxed);
+
+    if (m_pCurrent != nullptr)
+        m_pCurrent->graph->evaluate(frames);
+}
+
+std::size_t Engine::collect()
+{
+    std::size_t count = 0;
+
+    for (auto &slot : m_retired) {
+        if (Slot *pSlot = slot.exchange(nullptr, std::memory_order_acq_rel)) {
+            delete pSlot;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+} // namespace df
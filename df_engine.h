@@ -0,0 +1,105 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_ENGINE_H_INCLUDED
+#define DF_ENGINE_H_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Runs a graph on a real-time thread and replaces it on the fly.
+ *
+ * A new graph is built and prepared on another thread, then submitted.
+ * The real-time thread swaps it in at the beginning of the next evaluation,
+ * without allocating or locking. Nodes of the new graph having the same
+ * name and type as nodes of the running graph take over their state: the
+ * output values and whatever Node::inheritState() transfers.
+ *
+ * Replaced graphs are not destroyed by the real-time thread, collect()
+ * must be called from another thread to reclaim them.
+ */
+class Engine
+{
+public:
+
+    /// Number of replaced graphs waiting to be collected.
+    static constexpr std::size_t RetiredSlots = 4;
+
+    explicit Engine(std::unique_ptr<Graph> graph = nullptr);
+    ~Engine();
+
+    /**
+     * @brief Submit a graph to replace the running one.
+     * The graph gets prepared for the block size used so far. This is meant
+     * to be called by a single control thread, not the real-time thread.
+     * @return false if the previously submitted graph has not been swapped in yet.
+     */
+    bool submit(std::unique_ptr<Graph> graph);
+
+    /// Whether a submitted graph is waiting to be swapped in.
+    bool pending() const { return m_pending.load(std::memory_order_acquire) != nullptr; }
+
+    /// Evaluate a single frame, swapping the graph first if needed.
+    void evaluate();
+
+    /// Evaluate a block of frames, swapping the graph first if needed.
+    void evaluate(std::size_t frames);
+
+    /**
+     * @brief Running graph.
+     * Only to be used by the real-time thread, or when no evaluation is running.
+     */
+    Graph* graph() const { return m_pCurrent ? m_pCurrent->graph.get() : nullptr; }
+
+    /**
+     * @brief Destroy the replaced graphs.
+     * @return Number of graphs destroyed.
+     */
+    std::size_t collect();
+
+private:
+    Engine(const Engine&) = delete;
+    Engine& operator =(const Engine&) = delete;
+
+    // Graph along with the nodes inheriting the state
+    // from the graph it replaces.
+    struct Slot
+    {
+        std::unique_ptr<Graph> graph;
+        std::vector<std::pair<Node*, const Node*> > transfers;
+    };
+
+    // Swap the submitted graph in, on the real-time thread.
+    void swap();
+
+    Slot *m_pCurrent;
+    std::atomic<Slot*> m_pending;
+    std::atomic<Slot*> m_retired[RetiredSlots];
+
+    // Largest block evaluated, submitted graphs get reserved for it.
+    std::atomic<std::size_t> m_blockSize;
+};
+
+} // namespace df
+
+#endif // DF_ENGINE_H_INCLUDED
@@ -0,0 +1,219 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_HALF_H_INCLUDED
+#define DF_HALF_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include "df_simd.h"
+
+namespace df {
+
+/**
+ * @brief 16 bits floating point value (IEEE 754 binary16).
+ * Half the size of a float, with 11 bits of precision and a range of
+ * +/-65504. Arithmetic is done on floats, the results being rounded
+ * to the nearest value. This is a storage format: blocks take half the
+ * memory, and get converted in packs of floats with F16C instructions.
+ */
+class Half
+{
+public:
+
+    Half() : m_bits(0) {}
+    Half(float value) : m_bits(fromFloat(value)) {}
+
+    operator float() const { return toFloat(m_bits); }
+
+    Half& operator +=(float value) { return *this = float(*this) + value; }
+    Half& operator -=(float value) { return *this = float(*this) - value; }
+    Half& operator *=(float value) { return *this = float(*this) * value; }
+    Half& operator /=(float value) { return *this = float(*this) / value; }
+
+    std::uint16_t bits() const { return m_bits; }
+
+    static Half fromBits(std::uint16_t bits)
+    {
+        Half h;
+        h.m_bits = bits;
+        return h;
+    }
+
+    // Round to nearest even, overflows giving infinities.
+    static std::uint16_t fromFloat(float value)
+    {
+        std::uint32_t x = 0;
+        std::memcpy(&x, &value, sizeof(x));
+
+        const std::uint32_t sign = (x >> 16) & 0x8000u;
+        x &= 0x7fffffffu;
+
+        // Infinity and NaN, keeping NaN quiet
+        if (x >= 0x7f800000u)
+            return std::uint16_t(sign | 0x7c00u | (x > 0x7f800000u ? 0x0200u : 0u));
+
+        // Rounding to 65520 or above
+        if (x >= 0x477ff000u)
+            return std::uint16_t(sign | 0x7c00u);
+
+        // Subnormal results get rounded by the float addition
+        if (x < 0x38800000u) {
+            float f = 0.0f;
+            std::memcpy(&f, &x, sizeof(f));
+            f += 0.5f;
+            std::memcpy(&x, &f, sizeof(x));
+            return std::uint16_t(sign | (x - 0x3f000000u));
+        }
+
+        // Rebias the exponent and round the mantissa
+        const std::uint32_t odd = (x >> 13) & 1u;
+        x += 0xc8000fffu + odd;
+        return std::uint16_t(sign | (x >> 13));
+    }
+
+    static float toFloat(std::uint16_t bits)
+    {
+        const std::uint32_t sign = std::uint32_t(bits & 0x8000u) << 16;
+        const std::uint32_t exponent = (bits >> 10) & 0x1fu;
+        const std::uint32_t mantissa = bits & 0x3ffu;
+        std::uint32_t x = 0;
+
+        if (exponent == 0) {
+            const float f = float(mantissa) * (1.0f / 16777216.0f);
+            std::memcpy(&x, &f, sizeof(x));
+            x |= sign;
+        } else if (exponent == 0x1fu) {
+            x = sign | 0x7f800000u | (mantissa << 13);
+        } else {
+            x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float f = 0.0f;
+        std::memcpy(&f, &x, sizeof(f));
+        return f;
+    }
+
+private:
+
+    std::uint16_t m_bits;
+};
+
+/**
+ * @brief Brain floating point value: the upper 16 bits of a float.
+ * Same range as a float, with 8 bits of precision. Arithmetic is done on
+ * floats, the results being rounded to the nearest value.
+ */
+class BFloat16
+{
+public:
+
+    BFloat16() : m_bits(0) {}
+    BFloat16(float value) : m_bits(fromFloat(value)) {}
+
+    operator float() const { return toFloat(m_bits); }
+
+    BFloat16& operator +=(float value) { return *this = float(*this) + value; }
+    BFloat16& operator -=(float value) { return *this = float(*this) - value; }
+    BFloat16& operator *=(float value) { return *this = float(*this) * value; }
+    BFloat16& operator /=(float value) { return *this = float(*this) / value; }
+
+    std::uint16_t bits() const { return m_bits; }
+
+    static BFloat16 fromBits(std::uint16_t bits)
+    {
+        BFloat16 b;
+        b.m_bits = bits;
+        return b;
+    }
+
+    // Round to nearest even, keeping NaN quiet.
+    static std::uint16_t fromFloat(float value)
+    {
+        std::uint32_t x = 0;
+        std::memcpy(&x, &value, sizeof(x));
+
+        if ((x & 0x7fffffffu) > 0x7f800000u)
+            return std::uint16_t((x >> 16) | 0x0040u);
+
+        return std::uint16_t((x + 0x7fffu + ((x >> 16) & 1u)) >> 16);
+    }
+
+    static float toFloat(std::uint16_t bits)
+    {
+        const std::uint32_t x = std::uint32_t(bits) << 16;
+        float f = 0.0f;
+        std::memcpy(&f, &x, sizeof(f));
+        return f;
+    }
+
+private:
+
+    std::uint16_t m_bits;
+};
+
+namespace simd {
+
+#if defined(__AVX__) && defined(__F16C__)
+
+/// Halves computed as floats, converted by F16C instructions.
+template <>
+struct Pack<Half> : Pack<float>
+{
+    static Type load(const Half *p) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static void store(Half *p, Type v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT)); }
+    static Type broadcast(Half v) { return _mm256_set1_ps(float(v)); }
+};
+
+#endif
+
+#if defined(__AVX2__)
+
+/// Brain floats computed as floats, widened and rounded with integer instructions.
+template <>
+struct Pack<BFloat16> : Pack<float>
+{
+    static Type load(const BFloat16 *p)
+    {
+        const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(x, 16));
+    }
+
+    static void store(BFloat16 *p, Type v)
+    {
+        const __m256i x = _mm256_castps_si256(v);
+        const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+        const __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff))), 16);
+        const __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x0040));
+        const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        const __m256i bits = _mm256_blendv_epi8(rounded, quiet, nan);
+
+        // Pack the 32 bits lanes to 16 bits, in order
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0xd8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+    }
+
+    static Type broadcast(BFloat16 v) { return _mm256_set1_ps(float(v)); }
+};
+
+#endif
+
+} // namespace simd
+
+} // namespace df
+
+#endif // DF_HALF_H_INCLUDED
@@ -0,0 +1,682 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <typeinfo>
+#include <unordered_map>
+#include "df_jit.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define DF_JIT_DLOPEN 1
+#   include <dlfcn.h>
+#   include <unistd.h>
+#else
+#   define DF_JIT_DLOPEN 0
+#endif
+
+namespace df {
+
+namespace {
+
+// Frames computed at once by the compiled segments, as in node::Fused.
+constexpr std::size_t Tile = 64;
+
+// Nodes per segment, longer runs being split to keep the functions short.
+constexpr std::size_t SegmentNodes = 64;
+
+enum class Operation
+{
+    Neg,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Sum,
+    Product,
+    Convert
+};
+
+template <typename T> const char* typeName();
+template <> const char* typeName<float>() { return "float"; }
+template <> const char* typeName<double>() { return "double"; }
+template <> const char* typeName<std::int32_t>() { return "int32_t"; }
+template <> const char* typeName<std::int64_t>() { return "int64_t"; }
+
+template <typename T>
+void* outputBlock(Port *pPort) { return static_cast<Output<T>*>(pPort)->block(); }
+
+// Values are fetched between the blocks, when the ports refer to their own value.
+template <typename T>
+void* outputValue(Port *pPort) { return const_cast<T*>(&static_cast<Output<T>*>(pPort)->value()); }
+
+template <typename T>
+void* inputValue(Port *pPort) { return const_cast<T*>(&static_cast<Input<T>*>(pPort)->value()); }
+
+using Fetch = void* (*)(Port*);
+
+// Built-in node computed by the generated code.
+struct Compiled
+{
+    Operation operation;
+    Node *pNode;
+
+    const char *type;       // Output type
+    const char *from;       // Inputs type
+    bool saturate;          // Floating point to integer conversion
+
+    Fetch outputBlock;
+    Fetch outputValue;
+    Fetch sourceBlock;
+    Fetch sourceValue;
+    Fetch inputValue;
+};
+
+template <typename From, typename To>
+Compiled describe(Operation operation, Node *pNode)
+{
+    return Compiled {
+        operation, pNode,
+        typeName<To>(), typeName<From>(),
+        std::is_integral<To>::value && !std::is_integral<From>::value,
+        &outputBlock<To>, &outputValue<To>,
+        &outputBlock<From>, &outputValue<From>, &inputValue<From>
+    };
+}
+
+// Exact types only, derived nodes may compute something else.
+template <typename T>
+bool arithmetic(Node *pNode, Compiled &compiled)
+{
+    const std::type_info &type = typeid(*pNode);
+    Operation operation;
+
+    if (type == typeid(node::Neg<T>))
+        operation = Operation::Neg;
+    else if (type == typeid(node::Add<T>))
+        operation = Operation::Add;
+    else if (type == typeid(node::Sub<T>))
+        operation = Operation::Sub;
+    else if (type == typeid(node::Mul<T>))
+        operation = Operation::Mul;
+    else if (type == typeid(node::Div<T>))
+        operation = Operation::Div;
+    else if (type == typeid(node::Sum<T>))
+        operation = Operation::Sum;
+    else if (type == typeid(node::Product<T>))
+        operation = Operation::Product;
+    else
+        return false;
+
+    compiled = describe<T, T>(operation, pNode);
+    return true;
+}
+
+template <typename From, typename To>
+bool conversion(Node *pNode, Compiled &compiled)
+{
+    if (typeid(*pNode) != typeid(node::Convert<From, To>))
+        return false;
+
+    compiled = describe<From, To>(Operation::Convert, pNode);
+    return true;
+}
+
+template <typename From>
+bool conversions(Node *pNode, Compiled &compiled)
+{
+    return conversion<From, float>(pNode, compiled)
+        || conversion<From, double>(pNode, compiled)
+        || conversion<From, std::int32_t>(pNode, compiled)
+        || conversion<From, std::int64_t>(pNode, compiled);
+}
+
+bool recognize(Node *pNode, Compiled &compiled)
+{
+    if (pNode->rateDivisor() != 1)
+        return false;
+
+    return arithmetic<float>(pNode, compiled)
+        || arithmetic<double>(pNode, compiled)
+        || arithmetic<std::int32_t>(pNode, compiled)
+        || arithmetic<std::int64_t>(pNode, compiled)
+        || conversions<float>(pNode, compiled)
+        || conversions<double>(pNode, compiled)
+        || conversions<std::int32_t>(pNode, compiled)
+        || conversions<std::int64_t>(pNode, compiled);
+}
+
+const char *Prelude =
+    "#include <stddef.h>\n"
+    "#include <stdint.h>\n"
+    "\n"
+    "static inline int32_t df_int32_t(double v) { return v != v ? 0 : v <= (double)INT32_MIN ? INT32_MIN : v >= (double)INT32_MAX ? INT32_MAX : (int32_t)v; }\n"
+    "static inline int64_t df_int64_t(double v) { return v != v ? 0 : v <= (double)INT64_MIN ? INT64_MIN : v >= (double)INT64_MAX ? INT64_MAX : (int64_t)v; }\n";
+
+// Nodes of consecutive groups compiled into a pair of functions,
+// computing either a block or a single frame.
+class Segment
+{
+public:
+
+    Segment(std::size_t index, bool feedback)
+        : m_index(index),
+          m_feedback(feedback),
+          m_nodes(),
+          m_pointers(),
+          m_blocks(),
+          m_keys()
+    {}
+
+    bool feedback() const { return m_feedback; }
+
+    std::size_t size() const { return m_nodes.size(); }
+
+    void add(const Compiled &compiled) { m_nodes.push_back(compiled); }
+
+    const std::vector<Compiled>& nodes() const { return m_nodes; }
+
+    /**
+     * Write the functions.
+     * @param position Segment and position of the compiled nodes.
+     * @param stored Whether the output block of each node must be written.
+     */
+    void generate(std::ostream &code,
+                  const std::unordered_map<const Node*, std::pair<std::size_t, std::size_t> > &position,
+                  const std::vector<bool> &stored)
+    {
+        generateBlock(code, position, stored);
+        generateTick(code, position);
+    }
+
+    // Pointers the functions take, and the ones which change between blocks.
+    const std::vector<std::pair<Fetch, Port*> >& pointers() const { return m_pointers; }
+    const std::vector<std::size_t>& blocks() const { return m_blocks; }
+
+private:
+
+    // Index of a pointer of the table.
+    std::size_t pointer(Fetch fetch, Port *pPort, bool block)
+    {
+        const auto key = std::make_pair(pPort, block);
+        const auto it = m_keys.find(key);
+        if (it != m_keys.end())
+            return it->second;
+
+        const std::size_t index = m_pointers.size();
+        m_pointers.emplace_back(fetch, pPort);
+        if (block)
+            m_blocks.push_back(index);
+
+        m_keys[key] = index;
+        return index;
+    }
+
+    // Position of the node computing an input within this segment, or size().
+    std::size_t local(const InputPort *pInput,
+                      const std::unordered_map<const Node*, std::pair<std::size_t, std::size_t> > &position) const
+    {
+        const OutputPort *pSource = pInput->source();
+        if (pSource == nullptr || pSource->node() == nullptr)
+            return size();
+
+        const auto it = position.find(pSource->node());
+        if (it == position.end() || it->second.first != m_index)
+            return size();
+
+        return it->second.second;
+    }
+
+    static std::string expression(const Compiled &compiled, const std::vector<std::string> &operands)
+    {
+        const std::string type = compiled.type;
+
+        switch (compiled.operation) {
+        case Operation::Neg: return "(" + type + ")(-" + operands[0] + ")";
+        case Operation::Add: return "(" + type + ")(" + operands[0] + " + " + operands[1] + ")";
+        case Operation::Sub: return "(" + type + ")(" + operands[0] + " - " + operands[1] + ")";
+        case Operation::Mul: return "(" + type + ")(" + operands[0] + " * " + operands[1] + ")";
+        case Operation::Div: return "(" + type + ")(" + operands[0] + " / " + operands[1] + ")";
+
+        case Operation::Sum:
+        case Operation::Product: {
+            if (operands.empty())
+                return "(" + type + ")" + (compiled.operation == Operation::Sum ? "0" : "1");
+
+            const char *op = compiled.operation == Operation::Sum ? " + " : " * ";
+            std::string value = operands[0];
+            for (std::size_t i = 1; i < operands.size(); ++i)
+                value = "(" + type + ")(" + value + op + operands[i] + ")";
+            return value;
+        }
+
+        case Operation::Convert:
+            if (compiled.saturate)
+                return "df_" + type + "((double)" + operands[0] + ")";
+            return "(" + type + ")" + operands[0];
+        }
+
+        return std::string();
+    }
+
+    void generateBlock(std::ostream &code,
+                       const std::unordered_map<const Node*, std::pair<std::size_t, std::size_t> > &position,
+                       const std::vector<bool> &stored)
+    {
+        std::ostringstream header;
+        std::ostringstream body;
+        std::ostringstream footer;
+
+        // Within loops the nodes carry their value from a frame to the next,
+        // the feedback inputs reading it before it gets updated.
+        const std::string frame = m_feedback ? "i" : "offset + j";
+        const std::string indent = m_feedback ? "        " : "            ";
+
+        // Pointers are declared on their first use
+        std::set<std::size_t> declared;
+        auto declare = [&header, &declared](std::size_t p, const std::string &declaration) {
+            if (declared.insert(p).second)
+                header << "    " << declaration << ";\n";
+        };
+
+        for (std::size_t k = 0; k < size(); ++k) {
+            const Compiled &compiled = m_nodes[k];
+            const std::string type = compiled.type;
+            const std::string from = compiled.from;
+            const std::string value = (m_feedback ? "s" : "t") + std::to_string(k);
+            std::vector<std::string> operands;
+
+            for (auto *pInput : compiled.pNode->inputs()) {
+                const std::size_t source = local(pInput, position);
+
+                if (source < size()) {
+                    operands.push_back((m_feedback ? "s" : "t") + std::to_string(source) + (m_feedback ? "" : "[j]"));
+                } else if (pInput->source() == nullptr) {
+                    const std::size_t p = pointer(compiled.inputValue, pInput, false);
+                    declare(p, "const " + from + " c" + std::to_string(p) + " = *(const " + from + "*)p[" + std::to_string(p) + "]");
+                    operands.push_back("c" + std::to_string(p));
+                } else {
+                    const std::size_t p = pointer(compiled.sourceBlock, pInput->source(), true);
+                    declare(p, "const " + from + " *b" + std::to_string(p) + " = (const " + from + "*)p[" + std::to_string(p) + "]");
+                    operands.push_back("b" + std::to_string(p) + "[" + frame + "]");
+                }
+            }
+
+            OutputPort *pOutput = compiled.pNode->outputs().front();
+            const std::size_t v = pointer(compiled.outputValue, pOutput, false);
+
+            if (m_feedback) {
+                header << "    " << compiled.type << " " << value << " = *(" << compiled.type << "*)p[" << v << "];\n";
+                body << indent << value << " = " << expression(compiled, operands) << ";\n";
+                footer << "    *(" << compiled.type << "*)p[" << v << "] = " << value << ";\n";
+            } else {
+                header << "    " << compiled.type << " " << value << "[" << Tile << "];\n";
+                body << indent << "for (size_t j = 0; j < n; ++j) " << value << "[j] = " << expression(compiled, operands) << ";\n";
+            }
+
+            if (stored[k]) {
+                const std::size_t b = pointer(compiled.outputBlock, pOutput, true);
+                declare(b, type + " *o" + std::to_string(b) + " = (" + type + "*)p[" + std::to_string(b) + "]");
+
+                if (m_feedback) {
+                    body << indent << "o" << b << "[i] = " << value << ";\n";
+                } else {
+                    body << indent << "for (size_t j = 0; j < n; ++j) o" << b << "[offset + j] = " << value << "[j];\n";
+                    footer << "    *(" << compiled.type << "*)p[" << v << "] = o" << b << "[frames - 1];\n";
+                }
+            }
+        }
+
+        code << "\nstatic void b" << m_index << "(void *const *p, size_t frames)\n{\n" << header.str();
+
+        if (m_feedback) {
+            code << "    for (size_t i = 0; i < frames; ++i) {\n" << body.str() << "    }\n";
+        } else {
+            code << "    for (size_t offset = 0; offset < frames; offset += " << Tile << ") {\n"
+                 << "        const size_t n = frames - offset < " << Tile << " ? frames - offset : " << Tile << ";\n"
+                 << body.str() << "    }\n";
+        }
+
+        code << footer.str() << "}\n";
+    }
+
+    void generateTick(std::ostream &code,
+                      const std::unordered_map<const Node*, std::pair<std::size_t, std::size_t> > &position)
+    {
+        code << "\nstatic void t" << m_index << "(void *const *p)\n{\n";
+
+        for (std::size_t k = 0; k < size(); ++k) {
+            const Compiled &compiled = m_nodes[k];
+            std::vector<std::string> operands;
+
+            // Feedback inputs read the value of the previous tick
+            for (auto *pInput : compiled.pNode->inputs()) {
+                const std::size_t source = local(pInput, position);
+
+                if (source < k && !pInput->feedback()) {
+                    operands.push_back("v" + std::to_string(source));
+                } else {
+                    const std::size_t p = pInput->source() == nullptr
+                        ? pointer(compiled.inputValue, pInput, false)
+                        : pointer(compiled.sourceValue, pInput->source(), false);
+                    operands.push_back("*(const " + std::string(compiled.from) + "*)p[" + std::to_string(p) + "]");
+                }
+            }
+
+            const std::size_t v = pointer(compiled.outputValue, compiled.pNode->outputs().front(), false);
+            code << "    const " << compiled.type << " v" << k << " = " << expression(compiled, operands) << ";\n"
+                 << "    *(" << compiled.type << "*)p[" << v << "] = v" << k << ";\n";
+        }
+
+        code << "}\n";
+    }
+
+    std::size_t m_index;
+    bool m_feedback;
+
+    std::vector<Compiled> m_nodes;
+
+    std::vector<std::pair<Fetch, Port*> > m_pointers;
+    std::vector<std::size_t> m_blocks;
+    std::map<std::pair<Port*, bool>, std::size_t> m_keys;
+};
+
+#if DF_JIT_DLOPEN
+
+// Build the code into a shared library and load it.
+void* build(const std::string &compiler, const std::string &source)
+{
+    const char *pTemp = std::getenv("TMPDIR");
+    std::string directory = std::string(pTemp != nullptr && *pTemp != '\0' ? pTemp : "/tmp") + "/df_jit_XXXXXX";
+    if (::mkdtemp(&directory[0]) == nullptr)
+        return nullptr;
+
+    const std::string sourceFile = directory + "/graph.c";
+    const std::string libraryFile = directory + "/graph.so";
+    void *pLibrary = nullptr;
+
+    std::ofstream file(sourceFile);
+    file << source;
+    file.close();
+
+    if (file) {
+        const std::string command = compiler + " -ffp-contract=off -fPIC -shared -o '"
+            + libraryFile + "' '" + sourceFile + "' >/dev/null 2>&1";
+
+        if (std::system(command.c_str()) == 0)
+            pLibrary = ::dlopen(libraryFile.c_str(), RTLD_NOW | RTLD_LOCAL);
+    }
+
+    // The library stays mapped once loaded
+    std::remove(sourceFile.c_str());
+    std::remove(libraryFile.c_str());
+    ::rmdir(directory.c_str());
+
+    return pLibrary;
+}
+
+#endif
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+
+JitExecutor::JitExecutor()
+    : m_compiler(),
+      m_pGraph(nullptr),
+      m_revision(0),
+      m_steps(),
+      m_pointers(),
+      m_values(),
+      m_nodes(0),
+      m_source(),
+      m_pLibrary(nullptr),
+      m_compiledSource(),
+      m_pBlockFunctions(nullptr),
+      m_pTickFunctions(nullptr),
+      m_ready(false)
+{
+    const char *pCompiler = std::getenv("DF_JIT_CC");
+    m_compiler = pCompiler != nullptr && *pCompiler != '\0' ? pCompiler : "cc -O2 -ftree-vectorize -march=native";
+}
+
+JitExecutor::~JitExecutor()
+{
+    unload();
+}
+
+bool JitExecutor::available()
+{
+    return DF_JIT_DLOPEN != 0;
+}
+
+bool JitExecutor::compile(Graph &g)
+{
+    g.evaluationOrder();
+    update(g);
+
+    if (m_ready)
+        return true;
+
+#if DF_JIT_DLOPEN
+    if (m_nodes == 0)
+        return false;
+
+    void *pLibrary = build(m_compiler, m_source);
+    if (pLibrary == nullptr)
+        return false;
+
+    const auto *pBlockFunctions = reinterpret_cast<const BlockFunction*>(::dlsym(pLibrary, "df_block"));
+    const auto *pTickFunctions = reinterpret_cast<const TickFunction*>(::dlsym(pLibrary, "df_tick"));
+    if (pBlockFunctions == nullptr || pTickFunctions == nullptr) {
+        ::dlclose(pLibrary);
+        return false;
+    }
+
+    unload();
+    m_pLibrary = pLibrary;
+    m_pBlockFunctions = pBlockFunctions;
+    m_pTickFunctions = pTickFunctions;
+    m_compiledSource = m_source;
+    m_ready = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JitExecutor::unload()
+{
+#if DF_JIT_DLOPEN
+    if (m_pLibrary != nullptr)
+        ::dlclose(m_pLibrary);
+#endif
+
+    m_pLibrary = nullptr;
+    m_pBlockFunctions = nullptr;
+    m_pTickFunctions = nullptr;
+    m_compiledSource.clear();
+    m_ready = false;
+}
+
+void JitExecutor::update(Graph &g)
+{
+    if (m_pGraph == &g && m_revision == g.revision())
+        return;
+
+    m_pGraph = &g;
+    m_revision = g.revision();
+
+    const auto &order = g.evaluationOrder();
+    const auto &groups = g.groups();
+
+    // Groups made of built-in nodes only form the segments
+    std::vector<Segment> segments;
+    std::vector<std::size_t> segmentOf(groups.size(), std::size_t(-1));
+    std::unordered_map<const Node*, std::pair<std::size_t, std::size_t> > position;
+
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        std::vector<Compiled> nodes;
+        for (std::size_t k = groups[i].begin; k < groups[i].end; ++k) {
+            Compiled compiled;
+            if (!recognize(order[k], compiled))
+                break;
+            nodes.push_back(compiled);
+        }
+
+        if (nodes.size() != groups[i].end - groups[i].begin)
+            continue;
+
+        const bool extend = i > 0 && segmentOf[i - 1] != std::size_t(-1)
+            && segments.back().feedback() == groups[i].feedback
+            && segments.back().size() + nodes.size() <= SegmentNodes;
+
+        if (!extend)
+            segments.emplace_back(segments.size(), groups[i].feedback);
+
+        for (const auto &compiled : nodes) {
+            position[compiled.pNode] = std::make_pair(segments.size() - 1, segments.back().size());
+            segments.back().add(compiled);
+        }
+
+        segmentOf[i] = segments.size() - 1;
+    }
+
+    // Readers of each output, fused nodes reading the inputs of the nodes they replace
+    std::unordered_map<const OutputPort*, std::vector<const Node*> > readers;
+    auto addReaders = [&readers](const Node *pNode) {
+        for (const auto *pInput : pNode->inputs()) {
+            if (pInput->source() != nullptr)
+                readers[pInput->source()].push_back(pInput->node());
+        }
+    };
+
+    for (const auto *pNode : g.nodes())
+        addReaders(pNode);
+    for (const auto *pNode : order) {
+        if (&pNode->graph() == &g && position.find(pNode) == position.end())
+            addReaders(pNode);
+    }
+
+    std::ostringstream code;
+    code << Prelude;
+    m_steps.clear();
+    m_pointers.clear();
+    m_nodes = 0;
+
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        if (segmentOf[i] == std::size_t(-1)) {
+            if (m_steps.empty() || m_steps.back().compiled)
+                m_steps.push_back(Step { false, i, i + 1, 0, {} });
+            else
+                m_steps.back().end = i + 1;
+            continue;
+        }
+
+        const std::size_t s = segmentOf[i];
+        if (!m_steps.empty() && m_steps.back().compiled && m_steps.back().begin == s) {
+            m_steps.back().end = i + 1;
+            continue;
+        }
+
+        // Blocks only read within the segment are not written
+        Segment &segment = segments[s];
+        std::vector<bool> stored;
+        for (const auto &compiled : segment.nodes()) {
+            const OutputPort *pOutput = compiled.pNode->outputs().front();
+            const auto it = readers.find(pOutput);
+
+            bool internal = !pOutput->observed() && it != readers.end();
+            if (internal) {
+                for (const Node *pReader : it->second) {
+                    const auto reader = position.find(pReader);
+                    internal = internal && reader != position.end() && reader->second.first == s;
+                }
+            }
+            stored.push_back(!internal);
+        }
+
+        segment.generate(code, position, stored);
+        m_nodes += segment.size();
+
+        Step step { true, s, i + 1, m_pointers.size(), {} };
+        for (std::size_t b : segment.blocks())
+            step.blocks.push_back(m_pointers.size() + b);
+        for (const auto &pointer : segment.pointers())
+            m_pointers.push_back(Pointer { pointer.first, pointer.second });
+
+        m_steps.push_back(step);
+    }
+
+    if (!segments.empty()) {
+        code << "\nvoid (*const df_block[])(void *const *, size_t) = {";
+        for (std::size_t s = 0; s < segments.size(); ++s)
+            code << (s > 0 ? ", b" : " b") << s;
+        code << " };\n";
+
+        code << "void (*const df_tick[])(void *const *) = {";
+        for (std::size_t s = 0; s < segments.size(); ++s)
+            code << (s > 0 ? ", t" : " t") << s;
+        code << " };\n";
+    }
+
+    m_source = code.str();
+    m_ready = m_pLibrary != nullptr && m_source == m_compiledSource;
+
+    // Values do not move until the graph gets modified, blocks get fetched on each evaluation
+    m_values.resize(m_pointers.size());
+    for (std::size_t k = 0; k < m_pointers.size(); ++k)
+        m_values[k] = m_pointers[k].fetch(m_pointers[k].pPort);
+}
+
+void JitExecutor::evaluate(Graph &g, std::size_t frames)
+{
+    update(g);
+
+    if (!m_ready) {
+        for (std::size_t i = 0; i < g.groups().size(); ++i)
+            g.evaluateGroup(i, frames);
+        return;
+    }
+
+    for (const auto &step : m_steps) {
+        if (!step.compiled) {
+            for (std::size_t i = step.begin; i < step.end; ++i)
+                g.evaluateGroup(i, frames);
+            continue;
+        }
+
+        void *const *pValues = &m_values[step.firstPointer];
+
+        if (frames == 0) {
+            m_pTickFunctions[step.begin](pValues);
+            continue;
+        }
+
+        // Blocks may have been bound by the nodes evaluated so far
+        for (std::size_t k : step.blocks)
+            m_values[k] = m_pointers[k].fetch(m_pointers[k].pPort);
+
+        m_pBlockFunctions[step.begin](pValues, frames);
+    }
+}
+
+} // namespace df
@@ -0,0 +1,148 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_JIT_H_INCLUDED
+#define DF_JIT_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Executor running the graph as native code generated for it.
+ *
+ * compile() translates the runs of built-in arithmetic nodes (Neg, Add, Sub,
+ * Mul, Div, Sum, Product and Convert, of float, double, 32 and 64 bits
+ * integers) into C functions, builds them with the system compiler into a
+ * shared library, and loads it. The whole run then gets computed by a single
+ * call, the values staying in registers or in tiles of the stack instead of
+ * going through the nodes outputs, and the loops getting vectorized. Feedback
+ * loops made of built-in nodes are compiled as well, frame by frame. The other
+ * nodes are evaluated in between by the graph (see Graph::evaluateGroup()).
+ *
+ * As with fusion, the outputs read only by the nodes of the same run are not
+ * updated any more, unless they are observed (see OutputPort::observe()).
+ *
+ * When the graph gets prepared again, the code is generated anew, and kept if
+ * it did not change. Until the graph is compiled, or when the compilation
+ * fails, the graph is evaluated by the interpreter.
+ *
+ * Compiling needs a C compiler and dynamic loading (POSIX systems), it takes
+ * a while and must not happen while the graph is being evaluated.
+ *
+ * @code
+ * auto *pJit = new df::JitExecutor();
+ * g.executor(std::unique_ptr<df::Executor>(pJit));
+ * if (!pJit->compile(g))
+ *     std::cerr << "Interpreting the graph\n";
+ * @endcode
+ */
+class JitExecutor : public Executor
+{
+public:
+
+    JitExecutor();
+    ~JitExecutor() override;
+
+    /// Whether the code can be loaded on this platform.
+    static bool available();
+
+    /**
+     * @brief Command compiling the generated code, flags included.
+     * Defaults to the DF_JIT_CC environment variable, or to "cc -O2 -ftree-vectorize -march=native".
+     * The source file and the options to build a shared library get appended.
+     */
+    const std::string& compiler() const { return m_compiler; }
+    void compiler(const std::string &command) { m_compiler = command; }
+
+    /**
+     * @brief Generate and load the code of the graph, preparing it if needed.
+     * @return false if the code could not be built, or if there is nothing to compile,
+     *         the graph getting interpreted.
+     */
+    bool compile(Graph &g);
+
+    /// Whether the last graph evaluated runs the compiled code.
+    bool compiled() const { return m_ready; }
+
+    /// Number of nodes computed by the compiled code.
+    std::size_t compiledNodes() const { return m_ready ? m_nodes : 0; }
+
+    /// Generated code of the last graph evaluated or compiled.
+    const std::string& source() const { return m_source; }
+
+    void evaluate(Graph &g, std::size_t frames) override;
+
+private:
+    JitExecutor(const JitExecutor&) = delete;
+    JitExecutor& operator =(const JitExecutor&) = delete;
+
+    // Pointer passed to the generated code, fetched from a port.
+    struct Pointer
+    {
+        void* (*fetch)(Port *pPort);
+        Port *pPort;
+    };
+
+    // Either groups evaluated by the graph, or a compiled segment.
+    struct Step
+    {
+        bool compiled;
+        std::size_t begin;      ///< First group, or segment index.
+        std::size_t end;        ///< End of the groups.
+
+        // Pointers of the segment, and those fetched again on each block.
+        std::size_t firstPointer;
+        std::vector<std::size_t> blocks;
+    };
+
+    using BlockFunction = void (*)(void *const *pPointers, std::size_t frames);
+    using TickFunction = void (*)(void *const *pPointers);
+
+    // Generate the code and the steps when the graph has changed.
+    void update(Graph &g);
+
+    void unload();
+
+    std::string m_compiler;
+
+    const Graph *m_pGraph;
+    std::size_t m_revision;
+
+    std::vector<Step> m_steps;
+    std::vector<Pointer> m_pointers;
+    std::vector<void*> m_values;
+
+    // Nodes within the segments, and their code.
+    std::size_t m_nodes;
+    std::string m_source;
+
+    // Loaded library and the code it was built from.
+    void *m_pLibrary;
+    std::string m_compiledSource;
+    const BlockFunction *m_pBlockFunctions;
+    const TickFunction *m_pTickFunctions;
+
+    // Whether the code of the graph is the one loaded.
+    bool m_ready;
+};
+
+} // namespace df
+
+#endif // DF_JIT_H_INCLUDED
@@ -0,0 +1,190 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_LANES_H_INCLUDED
+#define DF_LANES_H_INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include "df_simd.h"
+
+namespace df {
+
+/**
+ * @brief Values of N instances of the same graph, one per lane.
+ *
+ * Using Lanes<T, N> as the value type of the nodes evaluates one topology
+ * over N instances at once: each port stores the values of all the instances
+ * next to each other, and the arithmetic processes them with vector
+ * instructions. Nodes written in terms of T arithmetic, like the built-in
+ * variables and elementwise operations, work lane-wise as is, state included.
+ *
+ * @code
+ * using Voices = df::Lanes<float, 16>;
+ *
+ * auto &gain = g.variable<Voices>(Voices(0.5f));
+ * auto &mul = g.mul<Voices>();
+ * @endcode
+ */
+template <typename T, std::size_t N>
+struct Lanes
+{
+    using Value = T;
+    static constexpr std::size_t Size = N;
+
+    T lanes[N];
+
+    Lanes() : lanes() {}
+
+    /// All the lanes set to the same value.
+    Lanes(const T &value)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            lanes[i] = value;
+    }
+
+    T& operator [](std::size_t lane) { return lanes[lane]; }
+    const T& operator [](std::size_t lane) const { return lanes[lane]; }
+
+    T* data() { return lanes; }
+    const T* data() const { return lanes; }
+
+    Lanes& operator +=(const Lanes &other) { return apply<simd::AddOp>(other); }
+    Lanes& operator -=(const Lanes &other) { return apply<simd::SubOp>(other); }
+    Lanes& operator *=(const Lanes &other) { return apply<simd::MulOp>(other); }
+    Lanes& operator /=(const Lanes &other) { return apply<simd::DivOp>(other); }
+
+    Lanes operator -() const
+    {
+        using P = simd::Pack<T>;
+        Lanes result;
+
+        for (std::size_t i = 0; i < Packed; i += P::Width)
+            P::store(result.lanes + i, P::neg(P::load(lanes + i)));
+        for (std::size_t i = Packed; i < N; ++i)
+            result.lanes[i] = -lanes[i];
+
+        return result;
+    }
+
+    /// Whether all the lanes are equal.
+    bool operator ==(const Lanes &other) const
+    {
+        for (std::size_t i = 0; i < N; ++i) {
+            if (!(lanes[i] == other.lanes[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool operator !=(const Lanes &other) const { return !(*this == other); }
+
+private:
+
+    // Lanes processed as whole packs, the bounds being known at compile
+    // time the remaining lanes loop gets unrolled.
+    static constexpr std::size_t Packed = N - N % simd::Pack<T>::Width;
+
+    template <class Op>
+    Lanes& apply(const Lanes &other)
+    {
+        using P = simd::Pack<T>;
+        using S = simd::Scalar<T>;
+
+        for (std::size_t i = 0; i < Packed; i += P::Width)
+            P::store(lanes + i, Op::template apply<P>(P::load(lanes + i), P::load(other.lanes + i)));
+        for (std::size_t i = Packed; i < N; ++i)
+            lanes[i] = Op::template apply<S>(lanes[i], other.lanes[i]);
+
+        return *this;
+    }
+};
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> operator +(Lanes<T, N> a, const Lanes<T, N> &b) { return a += b; }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> operator -(Lanes<T, N> a, const Lanes<T, N> &b) { return a -= b; }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> operator *(Lanes<T, N> a, const Lanes<T, N> &b) { return a *= b; }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> operator /(Lanes<T, N> a, const Lanes<T, N> &b) { return a /= b; }
+
+//----------------------------------------------------------
+// Mixing lanes with plain numbers, which apply to all the lanes.
+
+template <typename T, std::size_t N, typename U>
+using EnableScalar = typename std::enable_if<std::is_arithmetic<U>::value, Lanes<T, N> >::type;
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator +(const Lanes<T, N> &a, U b) { return a + Lanes<T, N>(T(b)); }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator +(U a, const Lanes<T, N> &b) { return Lanes<T, N>(T(a)) + b; }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator -(const Lanes<T, N> &a, U b) { return a - Lanes<T, N>(T(b)); }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator -(U a, const Lanes<T, N> &b) { return Lanes<T, N>(T(a)) - b; }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator *(const Lanes<T, N> &a, U b) { return a * Lanes<T, N>(T(b)); }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator *(U a, const Lanes<T, N> &b) { return Lanes<T, N>(T(a)) * b; }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator /(const Lanes<T, N> &a, U b) { return a / Lanes<T, N>(T(b)); }
+
+template <typename T, std::size_t N, typename U>
+inline EnableScalar<T, N, U> operator /(U a, const Lanes<T, N> &b) { return Lanes<T, N>(T(a)) / b; }
+
+//----------------------------------------------------------
+// Lane-wise functions, found by argument dependent lookup.
+
+/// Apply a function to each lane.
+template <typename T, std::size_t N, class F>
+inline Lanes<T, N> map(const Lanes<T, N> &a, F f)
+{
+    Lanes<T, N> result;
+    for (std::size_t i = 0; i < N; ++i)
+        result.lanes[i] = f(a.lanes[i]);
+    return result;
+}
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> abs(const Lanes<T, N> &a) { return map(a, [](T x) { return std::abs(x); }); }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> sqrt(const Lanes<T, N> &a) { return map(a, [](T x) { return std::sqrt(x); }); }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> exp(const Lanes<T, N> &a) { return map(a, [](T x) { return std::exp(x); }); }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> sin(const Lanes<T, N> &a) { return map(a, [](T x) { return std::sin(x); }); }
+
+template <typename T, std::size_t N>
+inline Lanes<T, N> cos(const Lanes<T, N> &a) { return map(a, [](T x) { return std::cos(x); }); }
+
+} // namespace df
+
+#endif // DF_LANES_H_INCLUDED
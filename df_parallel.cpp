@@ -0,0 +1,374 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <algorithm>
+#include "df_parallel.h"
+
+namespace df {
+
+namespace {
+
+// Busy-wait iterations before yielding or going to sleep.
+constexpr int SpinCount = 4096;
+
+template <class Predicate>
+void spinUntil(Predicate done)
+{
+    int spin = 0;
+    while (!done()) {
+        if (++spin > SpinCount)
+            std::this_thread::yield();
+    }
+}
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+
+ThreadPool::ThreadPool(std::size_t threads)
+    : m_workers(),
+      m_pJob(nullptr),
+      m_pInvoke(nullptr),
+      m_epoch(0),
+      m_running(0),
+      m_sleeping(0),
+      m_stop(false)
+{
+    for (std::size_t i = 1; i < threads; ++i)
+        m_workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    m_stop = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_epoch;
+    }
+    m_wakeUp.notify_all();
+
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::dispatch()
+{
+    m_running = m_workers.size();
+    ++m_epoch;
+
+    // Only pay for the notification if some workers went to sleep
+    if (m_sleeping > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wakeUp.notify_all();
+    }
+
+    m_pInvoke(m_pJob, 0);
+
+    spinUntil([this]() { return m_running.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPool::work(std::size_t thread)
+{
+    std::size_t epoch = 0;
+
+    for (;;) {
+        int spin = 0;
+        while (m_epoch == epoch && ++spin < SpinCount) {}
+
+        if (m_epoch == epoch) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_sleeping;
+            m_wakeUp.wait(lock, [this, epoch]() { return m_epoch != epoch; });
+            --m_sleeping;
+        }
+
+        if (m_stop)
+            return;
+
+        epoch = m_epoch;
+        m_pInvoke(m_pJob, thread);
+        m_running.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+//----------------------------------------------------------
+
+void Barrier::wait()
+{
+    const std::size_t phase = m_phase.load(std::memory_order_acquire);
+
+    if (m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == m_count) {
+        m_arrived.store(0, std::memory_order_relaxed);
+        m_phase.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    spinUntil([this, phase]() { return m_phase.load(std::memory_order_acquire) != phase; });
+}
+
+//----------------------------------------------------------
+
+LevelExecutor::LevelExecutor(std::size_t threads)
+    : m_pool(threads),
+      m_barrier(m_pool.size()),
+      m_pGraph(nullptr),
+      m_revision(0),
+      m_groups(),
+      m_levelBegin(),
+      m_picked()
+{
+}
+
+void LevelExecutor::update(const Graph &g)
+{
+    if (m_pGraph == &g && m_revision == g.revision())
+        return;
+
+    m_pGraph = &g;
+    m_revision = g.revision();
+
+    // Groups are listed in the evaluation order, so the level
+    // of each group is known by the time it is visited.
+    const auto &groups = g.groups();
+    std::vector<std::size_t> level(groups.size(), 0);
+    std::size_t levelCount = 0;
+
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        levelCount = std::max(levelCount, level[i] + 1);
+        for (std::size_t k : groups[i].successors)
+            level[k] = std::max(level[k], level[i] + 1);
+    }
+
+    m_levelBegin.assign(levelCount + 1, 0);
+    for (std::size_t i = 0; i < groups.size(); ++i)
+        ++m_levelBegin[level[i] + 1];
+    for (std::size_t l = 0; l < levelCount; ++l)
+        m_levelBegin[l + 1] += m_levelBegin[l];
+
+    m_groups.resize(groups.size());
+    std::vector<std::size_t> position(m_levelBegin.begin(), m_levelBegin.end() - 1);
+    for (std::size_t i = 0; i < groups.size(); ++i)
+        m_groups[position[level[i]]++] = i;
+
+    m_picked.reset(new std::atomic<std::size_t>[levelCount]);
+}
+
+void LevelExecutor::evaluate(Graph &g, std::size_t frames)
+{
+    update(g);
+
+    const std::size_t levelCount = levels();
+    for (std::size_t l = 0; l < levelCount; ++l)
+        m_picked[l].store(0, std::memory_order_relaxed);
+
+    const std::size_t threads = m_pool.size();
+
+    auto job = [&](std::size_t) {
+        for (std::size_t l = 0; l < levelCount; ++l) {
+            const std::size_t begin = m_levelBegin[l];
+            const std::size_t size = m_levelBegin[l + 1] - begin;
+
+            // Pick the groups in chunks to limit the contention
+            const std::size_t chunk = std::max<std::size_t>(1, size / (threads * 4));
+
+            for (;;) {
+                const std::size_t first = m_picked[l].fetch_add(chunk, std::memory_order_relaxed);
+                if (first >= size)
+                    break;
+
+                const std::size_t last = std::min(size, first + chunk);
+                for (std::size_t k = first; k < last; ++k)
+                    g.evaluateGroup(m_groups[begin + k], frames);
+            }
+
+            if (l + 1 < levelCount)
+                m_barrier.wait();
+        }
+    };
+
+    m_pool.run(job);
+}
+
+//----------------------------------------------------------
+
+WorkDeque::WorkDeque(std::size_t capacity)
+    : m_mask(0),
+      m_items(),
+      m_top(0),
+      m_bottom(0)
+{
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_mask = size - 1;
+    m_items.reset(new std::atomic<std::size_t>[size]);
+}
+
+void WorkDeque::clear()
+{
+    m_top.store(0, std::memory_order_relaxed);
+    m_bottom.store(0, std::memory_order_relaxed);
+}
+
+void WorkDeque::push(std::size_t item)
+{
+    const std::int64_t b = m_bottom.load(std::memory_order_relaxed);
+    m_items[b & m_mask].store(item, std::memory_order_relaxed);
+    m_bottom.store(b + 1, std::memory_order_release);
+}
+
+std::size_t WorkDeque::pop()
+{
+    const std::int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return Empty;
+    }
+
+    std::size_t item = m_items[b & m_mask].load(std::memory_order_relaxed);
+
+    if (t == b) {
+        // Last item, race against the thieves
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            item = Empty;
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return item;
+}
+
+std::size_t WorkDeque::steal()
+{
+    std::int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::int64_t b = m_bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return Empty;
+
+    const std::size_t item = m_items[t & m_mask].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return Empty;
+
+    return item;
+}
+
+//----------------------------------------------------------
+
+WorkStealingExecutor::WorkStealingExecutor(std::size_t threads)
+    : m_pool(threads),
+      m_pGraph(nullptr),
+      m_revision(0),
+      m_queues(),
+      m_roots(),
+      m_pending(),
+      m_remaining(0)
+{
+}
+
+void WorkStealingExecutor::update(const Graph &g)
+{
+    if (m_pGraph == &g && m_revision == g.revision())
+        return;
+
+    m_pGraph = &g;
+    m_revision = g.revision();
+
+    const auto &groups = g.groups();
+
+    m_queues.clear();
+    for (std::size_t i = 0; i < m_pool.size(); ++i)
+        m_queues.emplace_back(new WorkDeque(groups.size()));
+
+    m_roots.clear();
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].dependencies == 0)
+            m_roots.push_back(i);
+    }
+
+    m_pending.reset(new std::atomic<std::size_t>[groups.size()]);
+}
+
+void WorkStealingExecutor::evaluate(Graph &g, std::size_t frames)
+{
+    update(g);
+
+    const auto &groups = g.groups();
+    const std::size_t threads = m_pool.size();
+
+    for (std::size_t i = 0; i < groups.size(); ++i)
+        m_pending[i].store(groups[i].dependencies, std::memory_order_relaxed);
+
+    for (auto &queue : m_queues)
+        queue->clear();
+
+    // Spread the initial tasks over all the threads
+    for (std::size_t i = 0; i < m_roots.size(); ++i)
+        m_queues[i % threads]->push(m_roots[i]);
+
+    m_remaining.store(groups.size(), std::memory_order_relaxed);
+
+    auto job = [&](std::size_t thread) {
+        WorkDeque &queue = *m_queues[thread];
+
+        while (m_remaining.load(std::memory_order_acquire) > 0) {
+            std::size_t task = queue.pop();
+
+            for (std::size_t k = 1; task == WorkDeque::Empty && k < threads; ++k)
+                task = m_queues[(thread + k) % threads]->steal();
+
+            if (task == WorkDeque::Empty) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            g.evaluateGroup(task, frames);
+
+            for (std::size_t next : groups[task].successors) {
+                if (m_pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    queue.push(next);
+            }
+
+            m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    };
+
+    m_pool.run(job);
+}
+
+//----------------------------------------------------------
+
+std::unique_ptr<Executor> makeExecutor(Execution execution, std::size_t threads)
+{
+    switch (execution) {
+    case Execution::Levels:
+        return std::unique_ptr<Executor>(new LevelExecutor(threads));
+    case Execution::WorkStealing:
+        return std::unique_ptr<Executor>(new WorkStealingExecutor(threads));
+    default:
+        break;
+    }
+
+    return nullptr;
+}
+
+} // namespace df
@@ -0,0 +1,239 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_PARALLEL_H_INCLUDED
+#define DF_PARALLEL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Pool of persistent worker threads.
+ * Threads are created once, running a job only wakes them up.
+ * The calling thread takes part in every job as well.
+ */
+class ThreadPool
+{
+public:
+
+    /// @param threads Total number of threads running a job, including the caller.
+    explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    /// Number of threads running a job.
+    std::size_t size() const { return m_workers.size() + 1; }
+
+    /**
+     * @brief Run a job on all the threads and wait for its completion.
+     * The job is called with the thread index, zero being the calling thread.
+     */
+    template <class F>
+    void run(F &job)
+    {
+        m_pJob = &job;
+        m_pInvoke = &invoke<F>;
+        dispatch();
+    }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator =(const ThreadPool&) = delete;
+
+    template <class F>
+    static void invoke(void *pJob, std::size_t thread)
+    {
+        (*static_cast<F*>(pJob))(thread);
+    }
+
+    void dispatch();
+    void work(std::size_t thread);
+
+    std::vector<std::thread> m_workers;
+
+    void *m_pJob;
+    void (*m_pInvoke)(void*, std::size_t);
+
+    // Incremented for each job, workers wait for it to change.
+    std::atomic<std::size_t> m_epoch;
+
+    // Number of workers still running the current job.
+    std::atomic<std::size_t> m_running;
+
+    // Number of workers blocked on the condition variable.
+    std::atomic<std::size_t> m_sleeping;
+
+    std::atomic<bool> m_stop;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+};
+
+/**
+ * @brief Reusable spinning barrier.
+ */
+class Barrier
+{
+public:
+
+    explicit Barrier(std::size_t count = 1)
+        : m_count(count),
+          m_arrived(0),
+          m_phase(0)
+    {
+    }
+
+    void reset(std::size_t count) { m_count = count; }
+
+    /// Block until all the threads have arrived.
+    void wait();
+
+private:
+
+    std::size_t m_count;
+    std::atomic<std::size_t> m_arrived;
+    std::atomic<std::size_t> m_phase;
+};
+
+/**
+ * @brief Parallel executor based on dependency levels.
+ * Groups of nodes are split into levels, so that the groups on the same
+ * level do not depend on each other. Each level is evaluated in parallel
+ * by the thread pool, with a barrier before moving to the next level.
+ */
+class LevelExecutor : public Executor
+{
+public:
+
+    explicit LevelExecutor(std::size_t threads = std::thread::hardware_concurrency());
+
+    void evaluate(Graph &g, std::size_t frames) override;
+
+    /// Number of levels of the last evaluated graph.
+    std::size_t levels() const { return m_levelBegin.empty() ? 0 : m_levelBegin.size() - 1; }
+
+private:
+
+    // Recompute the levels when the graph gets modified.
+    void update(const Graph &g);
+
+    ThreadPool m_pool;
+    Barrier m_barrier;
+
+    const Graph *m_pGraph;
+    std::size_t m_revision;
+
+    // Groups ordered by level, and each level start offset.
+    std::vector<std::size_t> m_groups;
+    std::vector<std::size_t> m_levelBegin;
+
+    // Number of groups picked on each level.
+    std::unique_ptr<std::atomic<std::size_t>[]> m_picked;
+};
+
+/**
+ * @brief Work-stealing deque of group indices.
+ * The owning thread pushes and pops at the bottom, other threads
+ * steal from the top (Chase-Lev algorithm). The capacity is fixed.
+ */
+class WorkDeque
+{
+public:
+
+    static constexpr std::size_t Empty = std::size_t(-1);
+
+    explicit WorkDeque(std::size_t capacity);
+
+    /// Drop all the items, must not run concurrently with other calls.
+    void clear();
+
+    void push(std::size_t item);
+    std::size_t pop();
+    std::size_t steal();
+
+private:
+
+    std::size_t m_mask;
+    std::unique_ptr<std::atomic<std::size_t>[]> m_items;
+    std::atomic<std::int64_t> m_top;
+    std::atomic<std::int64_t> m_bottom;
+};
+
+/**
+ * @brief Parallel executor based on work stealing.
+ * Each group of nodes counts its pending dependencies, and becomes
+ * a task as soon as the last one has been evaluated. Tasks are queued
+ * on the thread that made them ready, idle threads steal the tasks
+ * queued by the others. This keeps all the threads busy when the graph
+ * branches have very different costs.
+ */
+class WorkStealingExecutor : public Executor
+{
+public:
+
+    explicit WorkStealingExecutor(std::size_t threads = std::thread::hardware_concurrency());
+
+    void evaluate(Graph &g, std::size_t frames) override;
+
+private:
+
+    void update(const Graph &g);
+
+    ThreadPool m_pool;
+
+    const Graph *m_pGraph;
+    std::size_t m_revision;
+
+    std::vector<std::unique_ptr<WorkDeque> > m_queues;
+
+    // Groups with no dependencies, that start each evaluation.
+    std::vector<std::size_t> m_roots;
+
+    // Dependencies left for each group.
+    std::unique_ptr<std::atomic<std::size_t>[]> m_pending;
+
+    // Groups left to evaluate.
+    std::atomic<std::size_t> m_remaining;
+};
+
+/**
+ * @brief Available evaluation strategies.
+ */
+enum class Execution
+{
+    Serial,         ///< Sequential evaluation on the calling thread.
+    Levels,         ///< LevelExecutor
+    WorkStealing    ///< WorkStealingExecutor
+};
+
+/**
+ * @brief Create an executor for the given strategy.
+ * Returns nullptr for the serial evaluation, which is the graph default.
+ */
+std::unique_ptr<Executor> makeExecutor(Execution execution,
+                                       std::size_t threads = std::thread::hardware_concurrency());
+
+} // namespace df
+
+#endif // DF_PARALLEL_H_INCLUDED
@@ -0,0 +1,105 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include "df_pipeline.h"
+
+namespace df {
+
+Pipeline::Pipeline(std::size_t threads)
+    : m_threads(threads),
+      m_pPool(),
+      m_stages(),
+      m_links(),
+      m_frames(),
+      m_evaluation(0),
+      m_capacity(1)
+{
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+std::size_t Pipeline::add(Graph &g)
+{
+    m_stages.push_back(&g);
+    m_pPool.reset();
+    reset();
+    return m_stages.size() - 1;
+}
+
+std::size_t Pipeline::stage(const Graph &g) const
+{
+    const auto it = std::find(m_stages.begin(), m_stages.end(), &g);
+    return it != m_stages.end() ? std::size_t(it - m_stages.begin()) : NoStage;
+}
+
+void Pipeline::reset()
+{
+    m_frames.assign(std::max<std::size_t>(m_stages.size(), 1), 0);
+    m_evaluation = 0;
+}
+
+void Pipeline::evaluate(std::size_t frames)
+{
+    const std::size_t count = m_stages.size();
+    if (count == 0)
+        return;
+
+    if (frames > m_capacity)
+        m_capacity = frames;
+
+    m_frames[m_evaluation % m_frames.size()] = frames;
+
+    for (auto &link : m_links) {
+        link->reserve(m_capacity);
+        link->bind(m_evaluation, m_frames);
+    }
+
+    // Each stage evaluates the block it has been reached by
+    auto evaluateStage = [this](std::size_t s) {
+        if (m_evaluation < s)
+            return;
+
+        const std::size_t n = m_frames[(m_evaluation - s) % m_frames.size()];
+        if (n == 0)
+            m_stages[s]->evaluate();
+        else
+            m_stages[s]->evaluate(n);
+    };
+
+    if (count == 1) {
+        evaluateStage(0);
+    } else {
+        if (!m_pPool) {
+            const std::size_t threads = m_threads == 0 ? count : std::min(m_threads, count);
+            m_pPool.reset(new ThreadPool(threads));
+        }
+
+        const std::size_t threads = m_pPool->size();
+        auto job = [&evaluateStage, count, threads](std::size_t thread) {
+            for (std::size_t s = thread; s < count; s += threads)
+                evaluateStage(s);
+        };
+
+        m_pPool->run(job);
+    }
+
+    ++m_evaluation;
+}
+
+} // namespace df
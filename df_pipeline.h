@@ -0,0 +1,222 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_PIPELINE_H_INCLUDED
+#define DF_PIPELINE_H_INCLUDED
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "df.h"
+#include "df_parallel.h"
+
+namespace df {
+
+/**
+ * @brief Graphs evaluated as the stages of a pipeline.
+ *
+ * A chain too deep to be evaluated in parallel can be split into graphs
+ * (stages), the outputs of a stage feeding sources of the following ones.
+ * The stages are then evaluated in parallel, one per thread: when a stage
+ * evaluates a block (or a tick), the next one evaluates the previous block.
+ * This adds a block of latency per stage, the outputs of the stage k lagging
+ * k blocks behind the first stage inputs. The stages are not evaluated until
+ * their first block reaches them.
+ *
+ * Each output connected to later stages writes its blocks into a ring that
+ * the sources read in place, so that the stages do not exchange anything
+ * besides the completion of the evaluation.
+ */
+class Pipeline
+{
+public:
+
+    static constexpr std::size_t NoStage = std::size_t(-1);
+
+    /// @param threads Threads evaluating the stages, zero for one per stage.
+    explicit Pipeline(std::size_t threads = 0);
+    ~Pipeline();
+
+    /**
+     * @brief Append a stage.
+     * The graph must outlive the pipeline, and only get evaluated by it.
+     * @return Index of the stage.
+     */
+    std::size_t add(Graph &g);
+
+    std::size_t stages() const { return m_stages.size(); }
+
+    /// Index of the stage evaluating the graph, or NoStage.
+    std::size_t stage(const Graph &g) const;
+
+    /**
+     * @brief Feed a source of a later stage with an output.
+     * The connections are made before the first evaluation, as making one
+     * restarts the pipeline (see reset()).
+     * @return false if the source does not belong to a later stage.
+     */
+    template <typename T>
+    bool connect(Output<T> &output, node::Source<T> &source);
+
+    /// Blocks (or ticks) the last stage lags behind the first one.
+    std::size_t latency() const { return m_stages.empty() ? 0 : m_stages.size() - 1; }
+
+    /// Evaluate a block of frames, or a single frame when zero.
+    void evaluate(std::size_t frames);
+    void evaluate() { evaluate(0); }
+
+    /// Drop the blocks in flight, the stages get evaluated again once reached by the next blocks.
+    void reset();
+
+private:
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator =(const Pipeline&) = delete;
+
+    // Ring of the blocks an output passes to later stages.
+    class Link
+    {
+    public:
+
+        Link(std::size_t from)
+            : m_from(from),
+              m_to(from)
+        {}
+
+        virtual ~Link() {}
+
+        // Allocate the blocks in flight.
+        virtual void reserve(std::size_t frames) = 0;
+
+        // Point the sink and sources to the blocks of the given evaluation.
+        virtual void bind(std::size_t evaluation, const std::vector<std::size_t> &frames) = 0;
+
+        std::size_t m_from;
+        std::size_t m_to;
+    };
+
+    template <typename T>
+    class LinkOf : public Link
+    {
+    public:
+
+        LinkOf(std::size_t from, Output<T> &output)
+            : Link(from),
+              m_pOutput(&output),
+              m_pSink(&output.node()->graph().template node<node::Sink<T> >()),
+              m_sources(),
+              m_blocks(),
+              m_capacity(0)
+        {
+            output >> m_pSink->template in<0>();
+        }
+
+        void reserve(std::size_t frames) override
+        {
+            const std::size_t slots = m_to - m_from + 1;
+            if (frames <= m_capacity && m_blocks.size() == slots * m_capacity)
+                return;
+
+            // Keep the blocks in flight
+            const std::size_t capacity = std::max(frames, m_capacity);
+            std::vector<T> blocks(slots * capacity);
+            for (std::size_t i = 0; i < slots && (i + 1) * m_capacity <= m_blocks.size(); ++i)
+                std::copy(&m_blocks[i * m_capacity], &m_blocks[i * m_capacity] + m_capacity, &blocks[i * capacity]);
+
+            m_blocks.swap(blocks);
+            m_capacity = capacity;
+        }
+
+        void bind(std::size_t evaluation, const std::vector<std::size_t> &frames) override
+        {
+            const std::size_t slots = m_to - m_from + 1;
+
+            if (evaluation >= m_from) {
+                const std::size_t block = evaluation - m_from;
+                m_pSink->bind(&m_blocks[(block % slots) * m_capacity], blockFrames(block, frames));
+            }
+
+            for (const auto &source : m_sources) {
+                if (evaluation >= source.second) {
+                    const std::size_t block = evaluation - source.second;
+                    source.first->bind(&m_blocks[(block % slots) * m_capacity], blockFrames(block, frames));
+                }
+            }
+        }
+
+        Output<T> *m_pOutput;
+        node::Sink<T> *m_pSink;
+
+        // Sources fed, with their stage.
+        std::vector<std::pair<node::Source<T>*, std::size_t> > m_sources;
+
+        std::vector<T> m_blocks;
+        std::size_t m_capacity;
+
+    private:
+
+        static std::size_t blockFrames(std::size_t block, const std::vector<std::size_t> &frames)
+        {
+            return std::max<std::size_t>(frames[block % frames.size()], 1);
+        }
+    };
+
+    std::size_t m_threads;
+    std::unique_ptr<ThreadPool> m_pPool;
+
+    std::vector<Graph*> m_stages;
+    std::vector<std::unique_ptr<Link> > m_links;
+
+    // Frames of the last blocks, one per stage, zero for a tick.
+    std::vector<std::size_t> m_frames;
+
+    // Evaluations since the pipeline got (re)started.
+    std::size_t m_evaluation;
+
+    // Largest block evaluated so far.
+    std::size_t m_capacity;
+};
+
+template <typename T>
+bool Pipeline::connect(Output<T> &output, node::Source<T> &source)
+{
+    const std::size_t from = output.node() != nullptr ? stage(output.node()->graph()) : NoStage;
+    const std::size_t to = stage(source.graph());
+    if (from == NoStage || to == NoStage || to <= from)
+        return false;
+
+    LinkOf<T> *pLink = nullptr;
+    for (auto &link : m_links) {
+        auto *pOther = dynamic_cast<LinkOf<T>*>(link.get());
+        if (pOther != nullptr && pOther->m_pOutput == &output)
+            pLink = pOther;
+    }
+
+    if (pLink == nullptr) {
+        pLink = new LinkOf<T>(from, output);
+        m_links.emplace_back(pLink);
+    }
+
+    pLink->m_sources.emplace_back(&source, to);
+    pLink->m_to = std::max(pLink->m_to, to);
+
+    reset();
+    return true;
+}
+
+} // namespace df
+
+#endif // DF_PIPELINE_H_INCLUDED
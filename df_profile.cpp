@@ -0,0 +1,213 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <typeinfo>
+#include "df.h"
+
+#if DF_PROFILING
+
+#if defined(__GNUG__)
+#   include <cxxabi.h>
+#endif
+
+namespace df {
+
+namespace {
+
+std::string typeName(const Node &node)
+{
+    const char *name = typeid(node).name();
+#if defined(__GNUG__)
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled != nullptr) {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    return name;
+}
+
+void writeEscaped(std::ostream &stream, const std::string &text)
+{
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            stream << '\\';
+        stream << c;
+    }
+}
+
+} // anonymous namespace
+
+namespace profile {
+
+double ticksPerSecond()
+{
+#if DF_PROFILE_RDTSC
+    static const double rate = []() {
+        const auto start = std::chrono::steady_clock::now();
+        const std::uint64_t ticks = now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {}
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return double(now() - ticks) / elapsed.count();
+    }();
+    return rate;
+#else
+    return 1e9;
+#endif
+}
+
+std::uint32_t threadIndex()
+{
+    static std::atomic<std::uint32_t> count(0);
+    static thread_local const std::uint32_t index = count++;
+    return index;
+}
+
+} // namespace profile
+
+//----------------------------------------------------------
+
+Stats::Stats()
+    : m_nodes(),
+      m_evaluations(),
+      m_events(),
+      m_capacity(0),
+      m_traceSize(0),
+      m_tracing(false),
+      m_traceStart(0)
+{
+    reset();
+}
+
+void Stats::reset()
+{
+    for (auto &stats : m_nodes)
+        stats = NodeStats { stats.node, 0, 0, 0, 0 };
+
+    m_evaluations = EvaluationStats { 0, 0, 0, 0 };
+}
+
+void Stats::attach(const std::vector<Node*> &nodes)
+{
+    // Statistics of the existing nodes are kept
+    for (std::size_t i = m_nodes.size(); i < nodes.size(); ++i)
+        m_nodes.push_back(NodeStats { nodes[i], 0, 0, 0, 0 });
+}
+
+void Stats::record(std::size_t node, std::uint64_t begin, std::uint64_t end, std::size_t frames)
+{
+    NodeStats &stats = m_nodes[node];
+    const std::uint64_t duration = end - begin;
+
+    ++stats.calls;
+    stats.frames += std::max<std::size_t>(frames, 1);
+    stats.total += duration;
+    stats.max = std::max(stats.max, duration);
+
+    if (m_tracing.load(std::memory_order_relaxed))
+        trace(std::uint32_t(node), begin, end, frames);
+}
+
+void Stats::recordEvaluation(std::uint64_t begin, std::uint64_t end, std::size_t frames)
+{
+    const std::uint64_t duration = end - begin;
+
+    ++m_evaluations.count;
+    m_evaluations.total += duration;
+    m_evaluations.max = std::max(m_evaluations.max, duration);
+    m_evaluations.last = duration;
+
+    if (m_tracing.load(std::memory_order_relaxed))
+        trace(GraphEvent, begin, end, frames);
+}
+
+void Stats::trace(std::uint32_t node, std::uint64_t begin, std::uint64_t end, std::size_t frames)
+{
+    const std::size_t index = m_traceSize.fetch_add(1, std::memory_order_relaxed);
+    if (index < m_capacity)
+        m_events[index] = Event { node, profile::threadIndex(), std::uint32_t(frames), begin, end };
+}
+
+void Stats::startTrace(std::size_t capacity)
+{
+    if (capacity != m_capacity) {
+        m_events.reset(new Event[capacity]);
+        m_capacity = capacity;
+    }
+
+    m_traceSize = 0;
+    m_traceStart = profile::now();
+    m_tracing = true;
+}
+
+void Stats::stopTrace()
+{
+    m_tracing = false;
+}
+
+std::size_t Stats::traceSize() const
+{
+    return std::min(m_traceSize.load(), m_capacity);
+}
+
+std::size_t Stats::traceDropped() const
+{
+    return m_traceSize.load() - traceSize();
+}
+
+void Stats::writeTrace(std::ostream &stream) const
+{
+    const double usPerTick = 1e6 / profile::ticksPerSecond();
+    const std::size_t count = traceSize();
+
+    // Names are resolved once per node
+    std::vector<std::string> names(m_nodes.size());
+
+    stream << "{\"traceEvents\":[";
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const Event &event = m_events[i];
+
+        stream << (i == 0 ? "\n" : ",\n") << "{\"name\":\"";
+
+        if (event.node == GraphEvent) {
+            stream << (event.frames == 0 ? "Graph::evaluate" : "Graph::evaluate(frames)");
+        } else {
+            std::string &name = names[event.node];
+            if (name.empty())
+                name = typeName(*m_nodes[event.node].node) + " #" + std::to_string(event.node);
+            writeEscaped(stream, name);
+        }
+
+        stream << "\",\"cat\":\"" << (event.node == GraphEvent ? "graph" : "node") << "\""
+               << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+               << ",\"ts\":" << double(event.begin - m_traceStart) * usPerTick
+               << ",\"dur\":" << double(event.end - event.begin) * usPerTick
+               << ",\"args\":{\"frames\":" << event.frames << "}}";
+    }
+
+    stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+} // namespace df
+
+#endif // DF_PROFILING
@@ -0,0 +1,177 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_PROFILE_H_INCLUDED
+#define DF_PROFILE_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define DF_PROFILE_RDTSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#   include <intrin.h>
+#   define DF_PROFILE_RDTSC 1
+#else
+#   define DF_PROFILE_RDTSC 0
+#endif
+
+namespace df {
+
+class Node;
+
+namespace profile {
+
+/**
+ * @brief Current time in clock ticks.
+ * This is the CPU time stamp counter where available,
+ * or nanoseconds of the steady clock otherwise.
+ */
+inline std::uint64_t now()
+{
+#if DF_PROFILE_RDTSC
+    return __rdtsc();
+#else
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/// Number of clock ticks per second, measured on the first call.
+double ticksPerSecond();
+
+/// Small index of the calling thread.
+std::uint32_t threadIndex();
+
+} // namespace profile
+
+/**
+ * @brief Evaluation statistics of a graph.
+ * Collected when the library is compiled with DF_PROFILING defined to 1.
+ * Durations are expressed in clock ticks (see profile::now()).
+ */
+class Stats
+{
+public:
+
+    /// Statistics of a single node.
+    struct NodeStats
+    {
+        const Node *node;       ///< Node these statistics refer to.
+        std::size_t calls;      ///< Number of evaluate() or process() calls.
+        std::size_t frames;     ///< Number of frames computed.
+        std::uint64_t total;    ///< Cumulative duration.
+        std::uint64_t max;      ///< Longest call.
+    };
+
+    /// Statistics of the whole graph evaluations, single frames or blocks.
+    struct EvaluationStats
+    {
+        std::size_t count;
+        std::uint64_t total;
+        std::uint64_t max;
+        std::uint64_t last;
+    };
+
+    Stats();
+
+    /// Statistics of all the nodes, in the creation order.
+    const std::vector<NodeStats>& nodes() const { return m_nodes; }
+
+    const EvaluationStats& evaluations() const { return m_evaluations; }
+
+    /// Clear the statistics.
+    void reset();
+
+    /// Convert clock ticks to seconds.
+    static double seconds(std::uint64_t ticks) { return double(ticks) / profile::ticksPerSecond(); }
+
+    /**
+     * @brief Start recording the trace events.
+     * The events are stored in a buffer allocated upfront,
+     * the events which do not fit are dropped.
+     */
+    void startTrace(std::size_t capacity = 1 << 16);
+    void stopTrace();
+
+    /// Number of recorded trace events.
+    std::size_t traceSize() const;
+
+    /// Number of trace events which did not fit the buffer.
+    std::size_t traceDropped() const;
+
+    /// Write the trace in the Chrome trace event format (chrome://tracing, Perfetto).
+    void writeTrace(std::ostream &stream) const;
+
+    /// Measure the evaluation of the whole graph, for the scope lifetime.
+    class Scope
+    {
+    public:
+        Scope(Stats &stats, std::size_t frames)
+            : m_stats(stats),
+              m_frames(frames),
+              m_begin(profile::now())
+        {
+        }
+
+        ~Scope() { m_stats.recordEvaluation(m_begin, profile::now(), m_frames); }
+
+    private:
+        Stats &m_stats;
+        std::size_t m_frames;
+        std::uint64_t m_begin;
+    };
+
+    // Called by the graph.
+    void attach(const std::vector<Node*> &nodes);
+    void record(std::size_t node, std::uint64_t begin, std::uint64_t end, std::size_t frames);
+    void recordEvaluation(std::uint64_t begin, std::uint64_t end, std::size_t frames);
+
+private:
+
+    static constexpr std::uint32_t GraphEvent = std::uint32_t(-1);
+
+    struct Event
+    {
+        std::uint32_t node;
+        std::uint32_t thread;
+        std::uint32_t frames;
+        std::uint64_t begin;
+        std::uint64_t end;
+    };
+
+    void trace(std::uint32_t node, std::uint64_t begin, std::uint64_t end, std::size_t frames);
+
+    std::vector<NodeStats> m_nodes;
+    EvaluationStats m_evaluations;
+
+    // Trace events buffer, filled concurrently by the executor threads.
+    std::unique_ptr<Event[]> m_events;
+    std::size_t m_capacity;
+    std::atomic<std::size_t> m_traceSize;
+    std::atomic<bool> m_tracing;
+    std::uint64_t m_traceStart;
+};
+
+} // namespace df
+
+#endif // DF_PROFILE_H_INCLUDED
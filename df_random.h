@@ -0,0 +1,116 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_RANDOM_H_INCLUDED
+#define DF_RANDOM_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace df {
+
+/**
+ * @brief Counter-based pseudo-random numbers generator.
+ *
+ * The n-th number of a stream is a hash (SplitMix64 finalizer) of the
+ * stream key and n, so that the numbers do not depend on each other:
+ * a block gets filled by independent iterations the compiler can vectorize,
+ * and any position of the stream can be reached directly. Streams of
+ * different keys are independent, which gives each generator instance
+ * its own reproducible sequence without sharing any state.
+ */
+class Random
+{
+public:
+
+    explicit Random(std::uint64_t seed = 0, std::uint64_t stream = 0)
+        : m_key(key(seed, stream)),
+          m_counter(0)
+    {
+    }
+
+    /// Select the stream and restart it.
+    void seed(std::uint64_t seed, std::uint64_t stream = 0)
+    {
+        m_key = key(seed, stream);
+        m_counter = 0;
+    }
+
+    /// Position in the stream.
+    std::uint64_t counter() const { return m_counter; }
+    void counter(std::uint64_t c) { m_counter = c; }
+
+    /// Next 64 random bits.
+    std::uint64_t next() { return bits(m_key, m_counter++); }
+
+    /// Next number uniformly distributed in [min, max).
+    template <typename T>
+    T uniform(T min, T max) { return min + (max - min) * unit<T>(next()); }
+
+    /**
+     * @brief Fill a block with numbers uniformly distributed in [min, max).
+     * This gives the same numbers as calling uniform() for each value.
+     */
+    template <typename T>
+    void uniform(T *out, std::size_t count, T min, T max)
+    {
+        const T range = max - min;
+        const std::uint64_t k = m_key;
+        const std::uint64_t c = m_counter;
+
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = min + range * unit<T>(bits(k, c + i));
+
+        m_counter += count;
+    }
+
+    /// Random bits at the given position of a stream.
+    static std::uint64_t bits(std::uint64_t key, std::uint64_t counter)
+    {
+        std::uint64_t z = key + counter * Gamma;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    /// Convert random bits to a number in [0, 1), using as many bits as the type precision.
+    template <typename T>
+    static T unit(std::uint64_t bits) { return T(double(bits >> 11) * (1.0 / 9007199254740992.0)); }
+
+private:
+
+    static constexpr std::uint64_t Gamma = 0x9e3779b97f4a7c15ull;
+
+    static std::uint64_t key(std::uint64_t seed, std::uint64_t stream)
+    {
+        // Scatter the keys, so that the streams do not overlap
+        return bits(bits(seed, 0), stream);
+    }
+
+    std::uint64_t m_key;
+    std::uint64_t m_counter;
+};
+
+template <>
+inline float Random::unit<float>(std::uint64_t bits)
+{
+    return float(std::uint32_t(bits >> 40)) * (1.0f / 16777216.0f);
+}
+
+} // namespace df
+
+#endif // DF_RANDOM_H_INCLUDED
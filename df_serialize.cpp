@@ -0,0 +1,433 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <cstring>
+#include "df_serialize.h"
+
+namespace df {
+
+namespace {
+
+// Byte order mark, reads differently on machines of the other endianness.
+constexpr std::uint32_t ByteOrder = 0x01020304;
+
+// Graph options.
+constexpr std::uint32_t Pruning = 1 << 0;
+constexpr std::uint32_t Fusion = 1 << 1;
+constexpr std::uint32_t Incremental = 1 << 2;
+
+// Output flags.
+constexpr std::uint32_t Observed = 1 << 0;
+
+template <typename T>
+void registerTypes(Registry &registry, const std::string &type)
+{
+    registry.add<node::Variable<T> >("Variable<" + type + ">");
+    registry.add<node::WhiteNoise<T> >("WhiteNoise<" + type + ">");
+    registry.add<node::Ramp<T> >("Ramp<" + type + ">");
+    registry.add<node::Smoother<T> >("Smoother<" + type + ">");
+    registry.add<node::Automation<T> >("Automation<" + type + ">");
+    registry.add<node::Interpolator<T> >("Interpolator<" + type + ">");
+    registry.add<node::Delay<T> >("Delay<" + type + ">");
+    registry.add<node::Source<T> >("Source<" + type + ">");
+    registry.add<node::Sink<T> >("Sink<" + type + ">");
+    registry.add<node::Neg<T> >("Neg<" + type + ">");
+    registry.add<node::Add<T> >("Add<" + type + ">");
+    registry.add<node::Sub<T> >("Sub<" + type + ">");
+    registry.add<node::Mul<T> >("Mul<" + type + ">");
+    registry.add<node::Div<T> >("Div<" + type + ">");
+    registry.add<node::Sum<T> >("Sum<" + type + ">");
+    registry.add<node::Product<T> >("Product<" + type + ">");
+    registry.add<node::Mix<T> >("Mix<" + type + ">");
+}
+
+class Writer
+{
+public:
+
+    explicit Writer(std::vector<char> &data)
+        : m_data(data)
+    {
+    }
+
+    void bytes(const void *pData, std::size_t size)
+    {
+        const char *p = static_cast<const char*>(pData);
+        m_data.insert(m_data.end(), p, p + size);
+    }
+
+    void u32(std::uint32_t value) { bytes(&value, sizeof(value)); }
+
+    void string(const std::string &str)
+    {
+        u32(std::uint32_t(str.size()));
+        bytes(str.data(), str.size());
+    }
+
+    // Reserve room for data written in place.
+    char* allocate(std::size_t size)
+    {
+        m_data.resize(m_data.size() + size);
+        return m_data.data() + m_data.size() - size;
+    }
+
+private:
+
+    std::vector<char> &m_data;
+};
+
+class Reader
+{
+public:
+
+    Reader(const void *pData, std::size_t size)
+        : m_pData(static_cast<const char*>(pData)),
+          m_pEnd(static_cast<const char*>(pData) + size)
+    {
+    }
+
+    const char* bytes(std::size_t size)
+    {
+        if (std::size_t(m_pEnd - m_pData) < size)
+            return nullptr;
+
+        const char *p = m_pData;
+        m_pData += size;
+        return p;
+    }
+
+    bool u32(std::uint32_t &value)
+    {
+        const char *p = bytes(sizeof(value));
+        if (p == nullptr)
+            return false;
+
+        std::memcpy(&value, p, sizeof(value));
+        return true;
+    }
+
+    // Sized block of bytes.
+    bool block(const char *&pData, std::uint32_t &size)
+    {
+        if (!u32(size))
+            return false;
+
+        pData = bytes(size);
+        return pData != nullptr;
+    }
+
+    std::size_t remaining() const { return std::size_t(m_pEnd - m_pData); }
+
+private:
+
+    const char *m_pData;
+    const char *m_pEnd;
+};
+
+// Position of a port in its node.
+template <class P>
+std::uint32_t portIndex(const std::vector<P*> &ports, const OutputPort *pPort)
+{
+    for (std::size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i] == pPort)
+            return std::uint32_t(i);
+    }
+    return std::uint32_t(-1);
+}
+
+// Node of the graph the input is connected to, or nullptr.
+const Node* sourceNode(const Graph &g, const InputPort *pInput)
+{
+    const OutputPort *pSource = pInput->source();
+    if (pSource == nullptr || pSource->node() == nullptr || &pSource->node()->graph() != &g)
+        return nullptr;
+    return pSource->node();
+}
+
+void savePort(Writer &writer, const Port &port)
+{
+    const std::size_t size = port.valueSize();
+    writer.u32(std::uint32_t(size));
+    if (size > 0)
+        port.saveValue(writer.allocate(size));
+}
+
+bool loadPort(Reader &reader, Port &port)
+{
+    const char *pValue = nullptr;
+    std::uint32_t size = 0;
+    if (!reader.block(pValue, size))
+        return false;
+
+    // Values of other types are not restored
+    if (size > 0 && size == port.valueSize())
+        port.loadValue(pValue);
+
+    return size == port.valueSize();
+}
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+
+Registry::Registry()
+    : m_factories(),
+      m_names()
+{
+    registerTypes<float>(*this, "float");
+    registerTypes<double>(*this, "double");
+
+    add<node::Convert<float, double> >("Convert<float,double>");
+    add<node::Convert<double, float> >("Convert<double,float>");
+}
+
+void Registry::add(const std::string &name, std::type_index type, Factory factory)
+{
+    m_factories[name] = factory;
+    m_names[type] = name;
+}
+
+Registry::Factory Registry::factory(const std::string &name) const
+{
+    const auto it = m_factories.find(name);
+    return it != m_factories.end() ? it->second : nullptr;
+}
+
+const std::string* Registry::name(const Node &node) const
+{
+    const auto it = m_names.find(typeid(node));
+    return it != m_names.end() ? &it->second : nullptr;
+}
+
+//----------------------------------------------------------
+
+bool save(const Graph &g, std::vector<char> &data, const Registry &registry)
+{
+    const auto &nodes = g.nodes();
+
+    // Types table
+    std::vector<const std::string*> types;
+    std::unordered_map<const std::string*, std::uint32_t> typeIndex;
+    std::vector<std::uint32_t> nodeTypes;
+    nodeTypes.reserve(nodes.size());
+
+    std::size_t connections = 0;
+
+    for (const Node *pNode : nodes) {
+        const std::string *pName = registry.name(*pNode);
+        if (pName == nullptr)
+            return false;
+
+        const auto it = typeIndex.emplace(pName, std::uint32_t(types.size())).first;
+        if (it->second == types.size())
+            types.push_back(pName);
+        nodeTypes.push_back(it->second);
+
+        for (const InputPort *pInput : pNode->inputs()) {
+            if (sourceNode(g, pInput) != nullptr)
+                ++connections;
+        }
+    }
+
+    data.clear();
+    Writer writer(data);
+
+    const double sampleRate = g.sampleRate();
+    const std::uint64_t frame = g.frame();
+    const std::uint32_t options = (g.pruning() ? Pruning : 0)
+                                | (g.fusion() ? Fusion : 0)
+                                | (g.incremental() ? Incremental : 0);
+
+    writer.bytes(format::Magic, sizeof(format::Magic));
+    writer.u32(format::Version);
+    writer.u32(ByteOrder);
+    writer.u32(options);
+    writer.bytes(&sampleRate, sizeof(sampleRate));
+    writer.bytes(&frame, sizeof(frame));
+    writer.u32(std::uint32_t(types.size()));
+    writer.u32(std::uint32_t(nodes.size()));
+    writer.u32(std::uint32_t(connections));
+
+    for (const std::string *pName : types)
+        writer.string(*pName);
+
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        const Node *pNode = nodes[i];
+
+        writer.u32(nodeTypes[i]);
+        writer.string(pNode->name());
+        writer.u32(std::uint32_t(pNode->rateDivisor()));
+
+        const std::size_t stateSize = pNode->stateSize();
+        writer.u32(std::uint32_t(stateSize));
+        if (stateSize > 0)
+            pNode->saveState(writer.allocate(stateSize));
+
+        writer.u32(std::uint32_t(pNode->inputs().size()));
+        for (const InputPort *pInput : pNode->inputs())
+            savePort(writer, *pInput);
+
+        writer.u32(std::uint32_t(pNode->outputs().size()));
+        for (const OutputPort *pOutput : pNode->outputs()) {
+            writer.u32(pOutput->observed() ? Observed : 0);
+            savePort(writer, *pOutput);
+        }
+    }
+
+    for (const Node *pNode : nodes) {
+        for (std::size_t i = 0; i < pNode->inputs().size(); ++i) {
+            const Node *pSourceNode = sourceNode(g, pNode->inputs()[i]);
+            if (pSourceNode == nullptr)
+                continue;
+
+            const OutputPort *pSource = pNode->inputs()[i]->source();
+            writer.u32(std::uint32_t(pSourceNode->index()));
+            writer.u32(portIndex(pSourceNode->outputs(), pSource));
+            writer.u32(std::uint32_t(pNode->index()));
+            writer.u32(std::uint32_t(i));
+        }
+    }
+
+    return true;
+}
+
+bool load(Graph &g, const void *pData, std::size_t size, const Registry &registry)
+{
+    Reader reader(pData, size);
+
+    const char *pMagic = reader.bytes(sizeof(format::Magic));
+    if (pMagic == nullptr || std::memcmp(pMagic, format::Magic, sizeof(format::Magic)) != 0)
+        return false;
+
+    std::uint32_t version = 0;
+    std::uint32_t byteOrder = 0;
+    std::uint32_t options = 0;
+    if (!reader.u32(version) || version != format::Version
+        || !reader.u32(byteOrder) || byteOrder != ByteOrder
+        || !reader.u32(options))
+        return false;
+
+    double sampleRate = 0.0;
+    const char *pSampleRate = reader.bytes(sizeof(sampleRate));
+    if (pSampleRate == nullptr)
+        return false;
+    std::memcpy(&sampleRate, pSampleRate, sizeof(sampleRate));
+
+    std::uint64_t frame = 0;
+    const char *pFrame = reader.bytes(sizeof(frame));
+    if (pFrame == nullptr)
+        return false;
+    std::memcpy(&frame, pFrame, sizeof(frame));
+
+    std::uint32_t typeCount = 0;
+    std::uint32_t nodeCount = 0;
+    std::uint32_t connectionCount = 0;
+    if (!reader.u32(typeCount) || !reader.u32(nodeCount) || !reader.u32(connectionCount)
+        || typeCount > reader.remaining() / sizeof(std::uint32_t))
+        return false;
+
+    g.sampleRate(sampleRate);
+    g.frame(frame);
+    g.pruning((options & Pruning) != 0);
+    g.fusion((options & Fusion) != 0);
+    g.incremental((options & Incremental) != 0);
+
+    // Names are only looked up once per type
+    std::vector<Registry::Factory> factories;
+    factories.reserve(typeCount);
+
+    for (std::uint32_t i = 0; i < typeCount; ++i) {
+        const char *pName = nullptr;
+        std::uint32_t length = 0;
+        if (!reader.block(pName, length))
+            return false;
+
+        const Registry::Factory factory = registry.factory(std::string(pName, length));
+        if (factory == nullptr)
+            return false;
+        factories.push_back(factory);
+    }
+
+    const std::size_t first = g.nodes().size();
+
+    for (std::uint32_t i = 0; i < nodeCount; ++i) {
+        std::uint32_t type = 0;
+        const char *pName = nullptr;
+        std::uint32_t length = 0;
+        std::uint32_t divisor = 0;
+        const char *pState = nullptr;
+        std::uint32_t stateSize = 0;
+
+        if (!reader.u32(type) || type >= factories.size()
+            || !reader.block(pName, length)
+            || !reader.u32(divisor)
+            || !reader.block(pState, stateSize))
+            return false;
+
+        Node &node = factories[type](g);
+        if (length > 0)
+            node.name(std::string(pName, length));
+        if (divisor != 1)
+            node.rateDivisor(divisor);
+        // The inputs of the node follow its state, each value in a sized block
+        std::uint32_t inputs = 0;
+        if (!reader.u32(inputs) || inputs > reader.remaining() / sizeof(std::uint32_t)
+            || !node.resizeInputs(inputs) || !node.loadState(pState, stateSize))
+            return false;
+        for (InputPort *pInput : node.inputs()) {
+            if (!loadPort(reader, *pInput))
+                return false;
+        }
+
+        std::uint32_t outputs = 0;
+        if (!reader.u32(outputs) || outputs != node.outputs().size())
+            return false;
+        for (OutputPort *pOutput : node.outputs()) {
+            std::uint32_t flags = 0;
+            if (!reader.u32(flags) || !loadPort(reader, *pOutput))
+                return false;
+            if ((flags & Observed) != 0)
+                pOutput->observe();
+        }
+    }
+
+    const auto &nodes = g.nodes();
+
+    for (std::uint32_t i = 0; i < connectionCount; ++i) {
+        std::uint32_t sourceNode = 0;
+        std::uint32_t sourceOutput = 0;
+        std::uint32_t targetNode = 0;
+        std::uint32_t targetInput = 0;
+
+        if (!reader.u32(sourceNode) || !reader.u32(sourceOutput)
+            || !reader.u32(targetNode) || !reader.u32(targetInput)
+            || sourceNode >= nodeCount || targetNode >= nodeCount)
+            return false;
+
+        const Node *pSource = nodes[first + sourceNode];
+        const Node *pTarget = nodes[first + targetNode];
+        if (sourceOutput >= pSource->outputs().size() || targetInput >= pTarget->inputs().size())
+            return false;
+
+        if (!pTarget->inputs()[targetInput]->connect(*pSource->outputs()[sourceOutput]))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace df
@@ -0,0 +1,98 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_SERIALIZE_H_INCLUDED
+#define DF_SERIALIZE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Node types known by name, to save and load graphs.
+ * The built-in nodes are registered for float and double,
+ * other types must be added before saving or loading.
+ */
+class Registry
+{
+public:
+
+    using Factory = Node& (*)(Graph &g);
+
+    Registry();
+
+    /// Register a node type, constructed with the graph as the only argument.
+    template <class N>
+    void add(const std::string &name)
+    {
+        add(name, typeid(N), [](Graph &g) -> Node& { return g.node<N>(); });
+    }
+
+    void add(const std::string &name, std::type_index type, Factory factory);
+
+    /// Factory of the named type, or nullptr.
+    Factory factory(const std::string &name) const;
+
+    /// Name the node type is registered with, or nullptr.
+    const std::string* name(const Node &node) const;
+
+private:
+
+    std::unordered_map<std::string, Factory> m_factories;
+    std::unordered_map<std::type_index, std::string> m_names;
+};
+
+/**
+ * @brief Binary graph format.
+ *
+ * The data holds the node types used, the nodes with their names, rate
+ * divisors, state (see Node::stateSize()) and port values, followed by the
+ * connections. Values are stored raw, in the byte order of the machine, so
+ * ports of types that are not trivially copyable keep their default value.
+ * Inputs bound to external values (Input::connect(T*)), or connected to
+ * the nodes of another graph, are saved unconnected.
+ */
+namespace format {
+
+constexpr char Magic[4] = { 'D', 'F', 'G', 'R' };
+constexpr std::uint32_t Version = 1;
+
+} // namespace format
+
+/**
+ * @brief Save the graph.
+ * @return false if a node type is not registered.
+ */
+bool save(const Graph &g, std::vector<char> &data, const Registry &registry);
+
+/**
+ * @brief Add the nodes of a saved graph to a graph.
+ * The data is read in place, so it can be a memory mapped file, and only
+ * the nodes get allocated. The graph is expected to be empty.
+ * @return false if the data is malformed, of another version, or refers to
+ *         unknown node types. The graph then holds the nodes loaded so far.
+ */
+bool load(Graph &g, const void *pData, std::size_t size, const Registry &registry);
+
+} // namespace df
+
+#endif // DF_SERIALIZE_H_INCLUDED
@@ -0,0 +1,280 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_SIMD_H_INCLUDED
+#define DF_SIMD_H_INCLUDED
+
+#include <cstddef>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+namespace df {
+namespace simd {
+
+/**
+ * @brief Single value pack.
+ * Used for the types without vector instructions, and for
+ * the values left after processing whole packs.
+ */
+template <typename T>
+struct Scalar
+{
+    using Type = T;
+    static constexpr std::size_t Width = 1;
+
+    static Type load(const T *p) { return *p; }
+    static void store(T *p, Type v) { *p = v; }
+    static Type broadcast(T v) { return v; }
+
+    static Type add(Type a, Type b) { return a + b; }
+    static Type sub(Type a, Type b) { return a - b; }
+    static Type mul(Type a, Type b) { return a * b; }
+    static Type div(Type a, Type b) { return a / b; }
+    static Type neg(Type a) { return -a; }
+};
+
+/**
+ * @brief Vector of values processed by a single instruction.
+ * The instruction set is selected at compile time (AVX, SSE2 or NEON),
+ * other types fall back to one value per pack.
+ */
+template <typename T>
+struct Pack : Scalar<T>
+{
+};
+
+#if defined(__AVX__)
+
+template <>
+struct Pack<float>
+{
+    using Type = __m256;
+    static constexpr std::size_t Width = 8;
+
+    static Type load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, Type v) { _mm256_storeu_ps(p, v); }
+    static Type broadcast(float v) { return _mm256_set1_ps(v); }
+
+    static Type add(Type a, Type b) { return _mm256_add_ps(a, b); }
+    static Type sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+    static Type mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+    static Type div(Type a, Type b) { return _mm256_div_ps(a, b); }
+    static Type neg(Type a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+};
+
+template <>
+struct Pack<double>
+{
+    using Type = __m256d;
+    static constexpr std::size_t Width = 4;
+
+    static Type load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, Type v) { _mm256_storeu_pd(p, v); }
+    static Type broadcast(double v) { return _mm256_set1_pd(v); }
+
+    static Type add(Type a, Type b) { return _mm256_add_pd(a, b); }
+    static Type sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+    static Type mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+    static Type div(Type a, Type b) { return _mm256_div_pd(a, b); }
+    static Type neg(Type a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+};
+
+#elif defined(__SSE2__)
+
+template <>
+struct Pack<float>
+{
+    using Type = __m128;
+    static constexpr std::size_t Width = 4;
+
+    static Type load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, Type v) { _mm_storeu_ps(p, v); }
+    static Type broadcast(float v) { return _mm_set1_ps(v); }
+
+    static Type add(Type a, Type b) { return _mm_add_ps(a, b); }
+    static Type sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+    static Type mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+    static Type div(Type a, Type b) { return _mm_div_ps(a, b); }
+    static Type neg(Type a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+};
+
+template <>
+struct Pack<double>
+{
+    using Type = __m128d;
+    static constexpr std::size_t Width = 2;
+
+    static Type load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, Type v) { _mm_storeu_pd(p, v); }
+    static Type broadcast(double v) { return _mm_set1_pd(v); }
+
+    static Type add(Type a, Type b) { return _mm_add_pd(a, b); }
+    static Type sub(Type a, Type b) { return _mm_sub_pd(a, b); }
+    static Type mul(Type a, Type b) { return _mm_mul_pd(a, b); }
+    static Type div(Type a, Type b) { return _mm_div_pd(a, b); }
+    static Type neg(Type a) { return _mm_xor_pd(a, _mm_set1_pd(-0.0)); }
+};
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+template <>
+struct Pack<float>
+{
+    using Type = float32x4_t;
+    static constexpr std::size_t Width = 4;
+
+    static Type load(const float *p) { return vld1q_f32(p); }
+    static void store(float *p, Type v) { vst1q_f32(p, v); }
+    static Type broadcast(float v) { return vdupq_n_f32(v); }
+
+    static Type add(Type a, Type b) { return vaddq_f32(a, b); }
+    static Type sub(Type a, Type b) { return vsubq_f32(a, b); }
+    static Type mul(Type a, Type b) { return vmulq_f32(a, b); }
+    static Type div(Type a, Type b) { return vdivq_f32(a, b); }
+    static Type neg(Type a) { return vnegq_f32(a); }
+};
+
+template <>
+struct Pack<double>
+{
+    using Type = float64x2_t;
+    static constexpr std::size_t Width = 2;
+
+    static Type load(const double *p) { return vld1q_f64(p); }
+    static void store(double *p, Type v) { vst1q_f64(p, v); }
+    static Type broadcast(double v) { return vdupq_n_f64(v); }
+
+    static Type add(Type a, Type b) { return vaddq_f64(a, b); }
+    static Type sub(Type a, Type b) { return vsubq_f64(a, b); }
+    static Type mul(Type a, Type b) { return vmulq_f64(a, b); }
+    static Type div(Type a, Type b) { return vdivq_f64(a, b); }
+    static Type neg(Type a) { return vnegq_f64(a); }
+};
+
+#endif
+
+//----------------------------------------------------------
+// Elementwise operations, usable on both packs and values.
+
+struct AddOp
+{
+    template <class P> static typename P::Type apply(typename P::Type a, typename P::Type b) { return P::add(a, b); }
+};
+
+struct SubOp
+{
+    template <class P> static typename P::Type apply(typename P::Type a, typename P::Type b) { return P::sub(a, b); }
+};
+
+struct MulOp
+{
+    template <class P> static typename P::Type apply(typename P::Type a, typename P::Type b) { return P::mul(a, b); }
+};
+
+struct DivOp
+{
+    template <class P> static typename P::Type apply(typename P::Type a, typename P::Type b) { return P::div(a, b); }
+};
+
+struct NegOp
+{
+    template <class P> static typename P::Type apply(typename P::Type a) { return P::neg(a); }
+};
+
+/**
+ * @brief Apply a unary operation to a block of values.
+ */
+template <class Op, typename T>
+inline void unary(const T *in, T *out, std::size_t frames)
+{
+    using P = Pack<T>;
+    using S = Scalar<T>;
+
+    std::size_t i = 0;
+
+    for (; i + P::Width <= frames; i += P::Width)
+        P::store(out + i, Op::template apply<P>(P::load(in + i)));
+
+    for (; i < frames; ++i)
+        out[i] = Op::template apply<S>(in[i]);
+}
+
+/**
+ * @brief Apply a binary operation to blocks of values.
+ * The remainder which does not fill a whole pack is processed one value at a time.
+ */
+template <class Op, typename T>
+inline void binary(const T *a, const T *b, T *out, std::size_t frames)
+{
+    using P = Pack<T>;
+    using S = Scalar<T>;
+
+    std::size_t i = 0;
+
+    for (; i + P::Width <= frames; i += P::Width)
+        P::store(out + i, Op::template apply<P>(P::load(a + i), P::load(b + i)));
+
+    for (; i < frames; ++i)
+        out[i] = Op::template apply<S>(a[i], b[i]);
+}
+
+/**
+ * @brief Multiply a block of values by a factor.
+ */
+template <typename T>
+inline void scale(const T *in, const T &factor, T *out, std::size_t frames)
+{
+    using P = Pack<T>;
+    using S = Scalar<T>;
+
+    const typename P::Type f = P::broadcast(factor);
+    std::size_t i = 0;
+
+    for (; i + P::Width <= frames; i += P::Width)
+        P::store(out + i, P::mul(P::load(in + i), f));
+
+    for (; i < frames; ++i)
+        out[i] = S::mul(in[i], factor);
+}
+
+/**
+ * @brief Add a block of values multiplied by a factor to another block.
+ */
+template <typename T>
+inline void multiplyAdd(const T *in, const T &factor, T *out, std::size_t frames)
+{
+    using P = Pack<T>;
+    using S = Scalar<T>;
+
+    const typename P::Type f = P::broadcast(factor);
+    std::size_t i = 0;
+
+    for (; i + P::Width <= frames; i += P::Width)
+        P::store(out + i, P::add(P::load(out + i), P::mul(P::load(in + i), f)));
+
+    for (; i < frames; ++i)
+        out[i] = S::add(out[i], S::mul(in[i], factor));
+}
+
+} // namespace simd
+} // namespace df
+
+#endif // DF_SIMD_H_INCLUDED
@@ -0,0 +1,218 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_STATIC_H_INCLUDED
+#define DF_STATIC_H_INCLUDED
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include "df.h"
+
+namespace df {
+
+/**
+ * @brief Graph with a fixed set of nodes known at compile time.
+ *
+ * Nodes are held by value in a tuple and evaluated in the order they
+ * are listed, so the list must follow the dependencies between the nodes.
+ * Inputs connected to a node listed after (or to the node itself) read the
+ * previous tick value, as with df::Graph. Since the concrete node types are
+ * known, the evaluation calls are not virtual and can be inlined.
+ *
+ * @code
+ * df::StaticGraph<df::node::Variable<float>,
+ *                 df::node::Variable<float>,
+ *                 df::node::Add<float> > g;
+ *
+ * g.node<0>() >> g.node<2>().in<0>();
+ * g.node<1>() >> g.node<2>().in<1>();
+ * g.evaluate();
+ * @endcode
+ */
+template <class... Ns>
+class StaticGraph
+{
+public:
+
+    static constexpr std::size_t Size = sizeof...(Ns);
+
+    template <std::size_t I>
+    using NodeType = typename std::tuple_element<I, std::tuple<Ns...> >::type;
+
+    StaticGraph()
+        : m_context(),
+          m_nodes(context<Ns>()...),
+          m_pNodes(),
+          m_frameByFrame(false)
+    {
+        attach(Indices());
+    }
+
+    double timeStep() const { return m_context.timeStep(); }
+    void timeStep(double dt) { m_context.timeStep(dt); }
+
+    double sampleRate() const { return m_context.sampleRate(); }
+    void sampleRate(double sr) { m_context.sampleRate(sr); }
+
+    std::size_t blockSize() const { return m_context.blockSize(); }
+
+    /// Allocate ports storage for blocks of given size.
+    void blockSize(std::size_t frames)
+    {
+        m_context.m_blockSize = frames;
+        reserve();
+    }
+
+    template <std::size_t I>
+    NodeType<I>& node() { return std::get<I>(m_nodes); }
+
+    /**
+     * @brief Detect the feedback connections.
+     * This is done automatically on evaluation whenever the
+     * connections have changed.
+     */
+    void prepare()
+    {
+        m_frameByFrame = false;
+
+        for (std::size_t k = 0; k < Size; ++k) {
+            for (auto *input : m_pNodes[k]->m_inputs) {
+                Node *pSource = input->source() != nullptr ? input->source()->node() : nullptr;
+                input->m_feedback = pSource != nullptr
+                    && &pSource->graph() == &m_context
+                    && pSource->m_index >= k;
+                m_frameByFrame = m_frameByFrame || input->m_feedback;
+            }
+        }
+
+        reserve();
+        m_context.m_prepared = true;
+    }
+
+    void evaluate()
+    {
+        if (!m_context.prepared())
+            prepare();
+
+        evaluateNodes(Indices());
+    }
+
+    /**
+     * @brief Evaluate a block of frames.
+     * Nodes process the whole block, unless there are feedback connections,
+     * in which case all the nodes are evaluated frame by frame.
+     */
+    void evaluate(std::size_t frames)
+    {
+        if (frames == 0)
+            return;
+
+        if (!m_context.prepared())
+            prepare();
+
+        if (frames > blockSize())
+            blockSize(frames);
+
+        for (auto *pNode : m_pNodes)
+            pNode->fill(frames);
+
+        if (m_frameByFrame) {
+            for (std::size_t i = 0; i < frames; ++i)
+                evaluateFrame(i, Indices());
+        } else {
+            processNodes(frames, Indices());
+        }
+
+        for (auto *pNode : m_pNodes)
+            pNode->rewind(frames);
+    }
+
+private:
+    StaticGraph(const StaticGraph&) = delete;
+    StaticGraph& operator =(const StaticGraph&) = delete;
+
+    using Indices = std::index_sequence_for<Ns...>;
+    using Expand = int[];
+
+    template <class>
+    Graph& context() { return m_context; }
+
+    template <std::size_t... Is>
+    void attach(std::index_sequence<Is...>)
+    {
+        m_pNodes = {{ &std::get<Is>(m_nodes)... }};
+        (void)Expand{ 0, (Graph::attachPorts(std::get<Is>(m_nodes)), 0)... };
+
+        for (std::size_t k = 0; k < Size; ++k)
+            m_pNodes[k]->m_index = k;
+    }
+
+    void reserve()
+    {
+        for (auto *pNode : m_pNodes)
+            pNode->reserve(blockSize());
+
+        if (blockSize() == 0)
+            return;
+
+        for (auto *pNode : m_pNodes) {
+            for (auto *port : pNode->m_inputs)
+                port->reserve(blockSize());
+            for (auto *port : pNode->m_outputs)
+                port->reserve(blockSize());
+        }
+    }
+
+    template <std::size_t... Is>
+    void evaluateNodes(std::index_sequence<Is...>)
+    {
+        (void)Expand{ 0, (std::get<Is>(m_nodes).Ns::evaluate(), 0)... };
+    }
+
+    template <std::size_t... Is>
+    void processNodes(std::size_t frames, std::index_sequence<Is...>)
+    {
+        (void)Expand{ 0, (std::get<Is>(m_nodes).Ns::process(frames), 0)... };
+    }
+
+    template <std::size_t... Is>
+    void evaluateFrame(std::size_t frame, std::index_sequence<Is...>)
+    {
+        (void)Expand{ 0, (seek(std::get<Is>(m_nodes), frame), std::get<Is>(m_nodes).Ns::evaluate(), 0)... };
+    }
+
+    static void seek(Node &n, std::size_t frame)
+    {
+        for (auto *port : n.m_inputs)
+            port->seek(frame);
+        for (auto *port : n.m_outputs)
+            port->seek(frame);
+    }
+
+    // Provides the time step and tracks the connection changes.
+    Graph m_context;
+
+    std::tuple<Ns...> m_nodes;
+    std::array<Node*, Size> m_pNodes;
+
+    bool m_frameByFrame;
+};
+
+} // namespace df
+
+#endif // DF_STATIC_H_INCLUDED
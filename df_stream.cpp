@@ -0,0 +1,685 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "df_stream.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define DF_STREAM_POSIX 1
+#   include <fcntl.h>
+#   include <unistd.h>
+#else
+#   define DF_STREAM_POSIX 0
+#endif
+
+namespace df {
+
+namespace {
+
+// Frames read or written by the I/O thread at once.
+constexpr std::size_t Batch = 4096;
+
+std::size_t sampleSize(StreamFormat::Sample sample)
+{
+    switch (sample) {
+    case StreamFormat::Sample::Int16: return 2;
+    case StreamFormat::Sample::Int32: return 4;
+    case StreamFormat::Sample::Float32: return 4;
+    case StreamFormat::Sample::Float64: return 8;
+    }
+    return 0;
+}
+
+double decode(const char *p, StreamFormat::Sample sample)
+{
+    switch (sample) {
+    case StreamFormat::Sample::Int16: {
+        std::int16_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return double(v) / 32768.0;
+    }
+    case StreamFormat::Sample::Int32: {
+        std::int32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return double(v) / 2147483648.0;
+    }
+    case StreamFormat::Sample::Float32: {
+        float v;
+        std::memcpy(&v, p, sizeof(v));
+        return double(v);
+    }
+    case StreamFormat::Sample::Float64: {
+        double v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    }
+    return 0.0;
+}
+
+void encode(double value, StreamFormat::Sample sample, char *p)
+{
+    switch (sample) {
+    case StreamFormat::Sample::Int16: {
+        const std::int16_t v = std::int16_t(std::max(-32768.0, std::min(32767.0, std::round(value * 32768.0))));
+        std::memcpy(p, &v, sizeof(v));
+        break;
+    }
+    case StreamFormat::Sample::Int32: {
+        const std::int32_t v = std::int32_t(std::max(-2147483648.0, std::min(2147483647.0, std::round(value * 2147483648.0))));
+        std::memcpy(p, &v, sizeof(v));
+        break;
+    }
+    case StreamFormat::Sample::Float32: {
+        const float v = float(value);
+        std::memcpy(p, &v, sizeof(v));
+        break;
+    }
+    case StreamFormat::Sample::Float64:
+        std::memcpy(p, &value, sizeof(value));
+        break;
+    }
+}
+
+// Whether the last read stopped for lack of data, on a non-blocking stream.
+// The error gets cleared, to read again later.
+bool wouldBlock(std::FILE *pFile)
+{
+    if (!std::ferror(pFile) || (errno != EAGAIN && errno != EWOULDBLOCK))
+        return false;
+
+    std::clearerr(pFile);
+    return true;
+}
+
+// Little endian fields of the WAV headers.
+std::uint32_t get(const unsigned char *p, std::size_t bytes)
+{
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i)
+        value |= std::uint32_t(p[i]) << (8 * i);
+    return value;
+}
+
+void put(char *p, std::uint32_t value, std::size_t bytes)
+{
+    for (std::size_t i = 0; i < bytes; ++i)
+        p[i] = char((value >> (8 * i)) & 0xff);
+}
+
+// Skip bytes of a stream which may not be seekable.
+bool skip(std::FILE *pFile, std::uint64_t bytes)
+{
+    char buffer[256];
+    while (bytes > 0) {
+        const std::size_t count = std::size_t(std::min<std::uint64_t>(bytes, sizeof(buffer)));
+        if (std::fread(buffer, 1, count, pFile) != count)
+            return false;
+        bytes -= count;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+//----------------------------------------------------------
+
+StreamBuffer::StreamBuffer(std::size_t capacity)
+    : m_values(),
+      m_mask(0),
+      m_written(0),
+      m_read(0)
+{
+    resize(capacity);
+}
+
+void StreamBuffer::resize(std::size_t capacity)
+{
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_values.assign(capacity > 0 ? size : 0, 0.0);
+    m_mask = size - 1;
+    clear();
+}
+
+std::size_t StreamBuffer::write(const double *pValues, std::size_t count)
+{
+    const std::size_t written = m_written.load(std::memory_order_relaxed);
+    const std::size_t read = m_read.load(std::memory_order_acquire);
+    count = std::min(count, capacity() - (written - read));
+
+    const std::size_t begin = written & m_mask;
+    const std::size_t first = std::min(count, capacity() - begin);
+    std::copy(pValues, pValues + first, m_values.begin() + begin);
+    std::copy(pValues + first, pValues + count, m_values.begin());
+
+    m_written.store(written + count, std::memory_order_release);
+    return count;
+}
+
+std::size_t StreamBuffer::read(double *pValues, std::size_t count)
+{
+    const std::size_t read = m_read.load(std::memory_order_relaxed);
+    const std::size_t written = m_written.load(std::memory_order_acquire);
+    count = std::min(count, written - read);
+
+    const std::size_t begin = read & m_mask;
+    const std::size_t first = std::min(count, capacity() - begin);
+    std::copy(m_values.begin() + begin, m_values.begin() + begin + first, pValues);
+    std::copy(m_values.begin(), m_values.begin() + (count - first), pValues + first);
+
+    m_read.store(read + count, std::memory_order_release);
+    return count;
+}
+
+void StreamBuffer::clear()
+{
+    m_written.store(0, std::memory_order_relaxed);
+    m_read.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------
+
+Stream::Stream()
+    : m_pIO(nullptr),
+      m_pFile(nullptr),
+      m_owned(false),
+      m_format(StreamFormat::raw()),
+      m_buffer(),
+      m_bytes(),
+      m_values()
+{
+}
+
+Stream::~Stream()
+{
+}
+
+void Stream::attach(StreamIO &io)
+{
+    m_pIO = &io;
+    io.add(this);
+}
+
+void Stream::detach()
+{
+    if (m_pIO != nullptr) {
+        m_pIO->remove(this);
+        m_pIO = nullptr;
+    }
+}
+
+//----------------------------------------------------------
+
+StreamReader::StreamReader()
+    : Stream(),
+      m_channel(0),
+      m_end(false),
+      m_remaining(0),
+      m_partial(0),
+      m_line(),
+      m_flags(-1)
+{
+}
+
+StreamReader::~StreamReader()
+{
+    close();
+}
+
+bool StreamReader::open(StreamIO &io, const std::string &path, const StreamFormat &format,
+                        std::size_t channel, std::size_t capacity)
+{
+    std::FILE *pFile = std::fopen(path.c_str(), format.type == StreamFormat::Type::Csv ? "r" : "rb");
+    if (pFile == nullptr)
+        return false;
+
+    if (!open(io, pFile, format, channel, capacity)) {
+        std::fclose(pFile);
+        return false;
+    }
+
+    m_owned = true;
+    return true;
+}
+
+bool StreamReader::open(StreamIO &io, std::FILE *pFile, const StreamFormat &format,
+                        std::size_t channel, std::size_t capacity)
+{
+    close();
+
+    m_pFile = pFile;
+    m_owned = false;
+    m_format = format;
+    m_channel = channel;
+    m_end.store(false, std::memory_order_relaxed);
+    m_remaining = std::uint64_t(-1);
+    m_partial = 0;
+    m_line.clear();
+
+    if (!readHeader()
+        || (format.type != StreamFormat::Type::Csv && m_channel >= m_format.channels)) {
+        m_pFile = nullptr;
+        return false;
+    }
+
+#if DF_STREAM_POSIX
+    // Pipes and sockets would block the I/O thread until a whole batch arrives
+    const int descriptor = fileno(pFile);
+    if (::lseek(descriptor, 0, SEEK_CUR) < 0) {
+        const int flags = ::fcntl(descriptor, F_GETFL);
+        if (flags != -1 && (flags & O_NONBLOCK) == 0 && ::fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) != -1)
+            m_flags = flags;
+    }
+#endif
+
+    // Fill the buffer before the first evaluation
+    m_buffer.resize(capacity);
+    while (service()) {}
+
+    attach(io);
+    return true;
+}
+
+void StreamReader::close()
+{
+    detach();
+
+#if DF_STREAM_POSIX
+    if (m_pFile != nullptr && m_flags != -1)
+        ::fcntl(fileno(m_pFile), F_SETFL, m_flags);
+#endif
+    m_flags = -1;
+
+    if (m_pFile != nullptr && m_owned)
+        std::fclose(m_pFile);
+
+    m_pFile = nullptr;
+    m_buffer.clear();
+}
+
+bool StreamReader::readHeader()
+{
+    if (m_format.type != StreamFormat::Type::Wav)
+        return sampleSize(m_format.sample) > 0 && m_format.channels > 0;
+
+    unsigned char header[12];
+    if (std::fread(header, 1, sizeof(header), m_pFile) != sizeof(header)
+        || std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 8, "WAVE", 4) != 0)
+        return false;
+
+    bool formatFound = false;
+
+    for (;;) {
+        unsigned char chunk[8];
+        if (std::fread(chunk, 1, sizeof(chunk), m_pFile) != sizeof(chunk))
+            return false;
+
+        const std::uint32_t size = get(chunk + 4, 4);
+
+        if (std::memcmp(chunk, "data", 4) == 0) {
+            m_remaining = size;
+            return formatFound;
+        }
+
+        if (std::memcmp(chunk, "fmt ", 4) != 0 || size < 16) {
+            if (!skip(m_pFile, size + (size & 1)))
+                return false;
+            continue;
+        }
+
+        unsigned char fmt[40] = {};
+        const std::size_t bytes = std::min<std::size_t>(size, sizeof(fmt));
+        if (std::fread(fmt, 1, bytes, m_pFile) != bytes || !skip(m_pFile, size - bytes + (size & 1)))
+            return false;
+
+        std::uint32_t tag = get(fmt, 2);
+        if (tag == 0xfffe && bytes >= 26)
+            tag = get(fmt + 24, 2);
+
+        m_format.channels = get(fmt + 2, 2);
+        m_format.sampleRate = get(fmt + 4, 4);
+        const std::uint32_t bits = get(fmt + 14, 2);
+
+        if (tag == 1 && bits == 16)
+            m_format.sample = StreamFormat::Sample::Int16;
+        else if (tag == 1 && bits == 32)
+            m_format.sample = StreamFormat::Sample::Int32;
+        else if (tag == 3 && bits == 32)
+            m_format.sample = StreamFormat::Sample::Float32;
+        else if (tag == 3 && bits == 64)
+            m_format.sample = StreamFormat::Sample::Float64;
+        else
+            return false;
+
+        formatFound = m_format.channels > 0;
+    }
+}
+
+bool StreamReader::service()
+{
+    if (m_end.load(std::memory_order_relaxed))
+        return false;
+
+    // Wait for a quarter of the buffer to be read
+    const std::size_t space = m_buffer.space();
+    if (space == 0 || space < m_buffer.capacity() / 4)
+        return false;
+
+    const std::size_t frames = std::min(space, Batch);
+    return m_format.type == StreamFormat::Type::Csv ? readCsv(frames) : readSamples(frames);
+}
+
+bool StreamReader::readSamples(std::size_t frames)
+{
+    const std::size_t bytes = sampleSize(m_format.sample);
+    const std::size_t frameBytes = bytes * m_format.channels;
+
+    // The bytes of a frame read in part come first
+    m_bytes.resize(frames * frameBytes);
+    const std::size_t wanted = std::size_t(std::min<std::uint64_t>(m_bytes.size() - m_partial, m_remaining));
+    const std::size_t read = std::fread(m_bytes.data() + m_partial, 1, wanted, m_pFile);
+
+    const std::size_t size = m_partial + read;
+    const std::size_t count = size / frameBytes;
+    m_values.resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+        m_values[i] = decode(&m_bytes[i * frameBytes + m_channel * bytes], m_format.sample);
+
+    m_buffer.write(m_values.data(), count);
+    m_remaining -= read;
+
+    m_partial = size - count * frameBytes;
+    std::memmove(m_bytes.data(), m_bytes.data() + count * frameBytes, m_partial);
+
+    if ((read < wanted && !wouldBlock(m_pFile)) || m_remaining < frameBytes - m_partial)
+        m_end.store(true, std::memory_order_release);
+
+    return count > 0;
+}
+
+bool StreamReader::readCsv(std::size_t frames)
+{
+    m_values.clear();
+    char chunk[1024];
+    bool end = false;
+
+    while (m_values.size() < frames) {
+        bool complete = false;
+
+        while (std::fgets(chunk, sizeof(chunk), m_pFile) != nullptr) {
+            m_line += chunk;
+            if (!m_line.empty() && m_line.back() == '\n') {
+                complete = true;
+                break;
+            }
+        }
+
+        // The rest of the line is read once available
+        if (!complete && wouldBlock(m_pFile))
+            break;
+
+        if (!complete && m_line.empty()) {
+            end = true;
+            break;
+        }
+
+        // Find the column and parse it, skipping the lines without a number there
+        const char *p = m_line.c_str();
+        for (std::size_t column = 0; column < m_channel && p != nullptr; ++column) {
+            p = std::strchr(p, ',');
+            if (p != nullptr)
+                ++p;
+        }
+
+        if (p != nullptr) {
+            char *pEnd = nullptr;
+            const double value = std::strtod(p, &pEnd);
+            if (pEnd != p)
+                m_values.push_back(value);
+        }
+
+        m_line.clear();
+    }
+
+    // The values go first, so that the stream does not look finished before they are read
+    m_buffer.write(m_values.data(), m_values.size());
+    if (end)
+        m_end.store(true, std::memory_order_release);
+
+    return !m_values.empty();
+}
+
+//----------------------------------------------------------
+
+StreamWriter::StreamWriter()
+    : Stream(),
+      m_flush(false),
+      m_written(0)
+{
+}
+
+StreamWriter::~StreamWriter()
+{
+    close();
+}
+
+bool StreamWriter::open(StreamIO &io, const std::string &path, const StreamFormat &format,
+                        std::size_t channels, std::size_t capacity)
+{
+    std::FILE *pFile = std::fopen(path.c_str(), format.type == StreamFormat::Type::Csv ? "w" : "wb");
+    if (pFile == nullptr)
+        return false;
+
+    if (!open(io, pFile, format, channels, capacity)) {
+        std::fclose(pFile);
+        return false;
+    }
+
+    m_owned = true;
+    return true;
+}
+
+bool StreamWriter::open(StreamIO &io, std::FILE *pFile, const StreamFormat &format,
+                        std::size_t channels, std::size_t capacity)
+{
+    close();
+
+    if (channels == 0 || sampleSize(format.sample) == 0)
+        return false;
+
+    m_pFile = pFile;
+    m_owned = false;
+    m_format = format;
+    m_format.channels = channels;
+    m_flush.store(false, std::memory_order_relaxed);
+    m_written = 0;
+
+    if (m_format.type == StreamFormat::Type::Wav)
+        writeHeader(0);
+
+    m_buffer.resize(capacity * channels);
+    attach(io);
+    return true;
+}
+
+void StreamWriter::close()
+{
+    detach();
+
+    if (m_pFile == nullptr)
+        return;
+
+    drain(true);
+
+    // Complete the header, when the stream can be rewound
+    if (m_format.type == StreamFormat::Type::Wav && std::fseek(m_pFile, 0, SEEK_SET) == 0)
+        writeHeader(m_written);
+
+    if (m_owned)
+        std::fclose(m_pFile);
+    else
+        std::fflush(m_pFile);
+
+    m_pFile = nullptr;
+    m_buffer.clear();
+}
+
+bool StreamWriter::service()
+{
+    return drain(m_flush.exchange(false, std::memory_order_acq_rel));
+}
+
+bool StreamWriter::drain(bool all)
+{
+    const std::size_t channels = m_format.channels;
+    const std::size_t batch = std::max<std::size_t>(1, std::min(Batch, m_buffer.capacity() / 2 / channels)) * channels;
+    bool written = false;
+
+    for (;;) {
+        const std::size_t available = m_buffer.size();
+        if (available == 0 || (!all && available < batch))
+            break;
+
+        // Frames are queued whole, batches hold whole frames as well
+        m_values.resize(batch);
+        const std::size_t count = m_buffer.read(m_values.data(), std::min(available, batch));
+
+        if (m_format.type == StreamFormat::Type::Csv) {
+            m_bytes.resize(count * 26);
+            char *p = m_bytes.data();
+            for (std::size_t i = 0; i < count; ++i) {
+                p += std::snprintf(p, 26, "%.17g", m_values[i]);
+                *p++ = (i + 1) % channels == 0 ? '\n' : ',';
+            }
+            std::fwrite(m_bytes.data(), 1, std::size_t(p - m_bytes.data()), m_pFile);
+        } else {
+            const std::size_t bytes = sampleSize(m_format.sample);
+            m_bytes.resize(count * bytes);
+            for (std::size_t i = 0; i < count; ++i)
+                encode(m_values[i], m_format.sample, &m_bytes[i * bytes]);
+            std::fwrite(m_bytes.data(), 1, m_bytes.size(), m_pFile);
+            m_written += m_bytes.size();
+        }
+
+        written = true;
+    }
+
+    if (all && written)
+        std::fflush(m_pFile);
+
+    return written;
+}
+
+void StreamWriter::writeHeader(std::uint64_t dataSize)
+{
+    const std::uint32_t size = std::uint32_t(std::min<std::uint64_t>(dataSize, 0xffffffffu - 36));
+    const std::uint32_t bytes = std::uint32_t(sampleSize(m_format.sample));
+    const std::uint32_t channels = std::uint32_t(m_format.channels);
+    const bool floating = m_format.sample == StreamFormat::Sample::Float32
+        || m_format.sample == StreamFormat::Sample::Float64;
+
+    char header[44];
+    std::memcpy(header, "RIFF", 4);
+    put(header + 4, 36 + size, 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put(header + 16, 16, 4);
+    put(header + 20, floating ? 3 : 1, 2);
+    put(header + 22, channels, 2);
+    put(header + 24, m_format.sampleRate, 4);
+    put(header + 28, m_format.sampleRate * channels * bytes, 4);
+    put(header + 32, channels * bytes, 2);
+    put(header + 34, bytes * 8, 2);
+    std::memcpy(header + 36, "data", 4);
+    put(header + 40, size, 4);
+
+    std::fwrite(header, 1, sizeof(header), m_pFile);
+}
+
+//----------------------------------------------------------
+
+StreamIO::StreamIO(std::chrono::microseconds period)
+    : m_period(period),
+      m_streams(),
+      m_pServiced(nullptr),
+      m_mutex(),
+      m_wakeUp(),
+      m_serviced(),
+      m_stop(false),
+      m_thread()
+{
+    m_thread = std::thread(&StreamIO::run, this);
+}
+
+StreamIO::~StreamIO()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_wakeUp.notify_one();
+    m_thread.join();
+}
+
+void StreamIO::add(Stream *pStream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams.push_back(pStream);
+}
+
+void StreamIO::remove(Stream *pStream)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_streams.erase(std::remove(m_streams.begin(), m_streams.end(), pStream), m_streams.end());
+
+    // The stream may be in the middle of a read or a write
+    m_serviced.wait(lock, [this, pStream]() { return m_pServiced != pStream; });
+}
+
+void StreamIO::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_stop) {
+        bool busy = false;
+
+        // The list may change while a stream is serviced
+        for (std::size_t i = 0; i < m_streams.size(); ++i) {
+            Stream *pStream = m_streams[i];
+            m_pServiced = pStream;
+            lock.unlock();
+
+            busy = pStream->service() || busy;
+
+            lock.lock();
+            m_pServiced = nullptr;
+            m_serviced.notify_all();
+        }
+
+        if (!busy)
+            m_wakeUp.wait_for(lock, m_period);
+    }
+}
+
+} // namespace df
@@ -0,0 +1,513 @@
+/*
+                          dataflow-cpp
+
+    Copyright (C) 2018 Arthur Benilov,
+    arthur.benilov@gmail.com
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This software is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    Lesser General Public License for more details.
+*/
+
+#ifndef DF_STREAM_H_INCLUDED
+#define DF_STREAM_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "df.h"
+
+namespace df {
+
+class StreamIO;
+
+/**
+ * @brief Encoding of a stream of frames.
+ * Raw streams hold interleaved samples in the machine byte order, as do WAV
+ * files (which are little endian), the channels and sample type of these
+ * being read from the header. Integer samples map to [-1, 1). CSV streams
+ * hold one frame per line, the channels being separated by commas, and
+ * the lines which are not numbers (like a header) are skipped.
+ */
+struct StreamFormat
+{
+    enum class Type
+    {
+        Raw,
+        Wav,
+        Csv
+    };
+
+    enum class Sample
+    {
+        Int16,
+        Int32,
+        Float32,
+        Float64
+    };
+
+    Type type;
+    Sample sample;
+
+    /// Channels of the raw streams read, of the streams written.
+    std::size_t channels;
+
+    /// Sample rate of the WAV files written.
+    unsigned sampleRate;
+
+    static StreamFormat raw(Sample sample = Sample::Float32, std::size_t channels = 1)
+    {
+        return StreamFormat { Type::Raw, sample, channels, 0 };
+    }
+
+    static StreamFormat wav(Sample sample = Sample::Float32, unsigned sampleRate = 48000)
+    {
+        return StreamFormat { Type::Wav, sample, 1, sampleRate };
+    }
+
+    static StreamFormat csv() { return StreamFormat { Type::Csv, Sample::Float64, 1, 0 }; }
+};
+
+/**
+ * @brief Single producer, single consumer ring of values.
+ * One thread writes while another one reads, neither of them blocking.
+ */
+class StreamBuffer
+{
+public:
+
+    /// The capacity gets rounded up to a power of two.
+    explicit StreamBuffer(std::size_t capacity = 0);
+
+    void resize(std::size_t capacity);
+
+    std::size_t capacity() const { return m_values.size(); }
+
+    /// Values available for reading.
+    std::size_t size() const
+    {
+        return m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire);
+    }
+
+    /// Room available for writing.
+    std::size_t space() const { return capacity() - size(); }
+
+    /// @return number of values written, limited by the space.
+    std::size_t write(const double *pValues, std::size_t count);
+
+    /// @return number of values read, limited by the size.
+    std::size_t read(double *pValues, std::size_t count);
+
+    void clear();
+
+private:
+
+    std::vector<double> m_values;
+    std::size_t m_mask;
+
+    // Values written and read so far, by the producer and the consumer.
+    std::atomic<std::size_t> m_written;
+    std::atomic<std::size_t> m_read;
+};
+
+/**
+ * @brief File, pipe or socket serviced by the I/O thread.
+ * The evaluation thread only exchanges frames with the ring buffer, while
+ * the I/O thread reads ahead or writes behind in large batches.
+ */
+class Stream
+{
+public:
+
+    Stream();
+    virtual ~Stream();
+
+    bool isOpen() const { return m_pFile != nullptr; }
+
+    /// Format of the stream, as read from the header of WAV files.
+    const StreamFormat& format() const { return m_format; }
+
+protected:
+
+    friend class StreamIO;
+
+    // Read or write a batch, called by the I/O thread.
+    // @return false if there was nothing to do.
+    virtual bool service() = 0;
+
+    void attach(StreamIO &io);
+    void detach();
+
+    StreamIO *m_pIO;
+    std::FILE *m_pFile;
+    bool m_owned;
+    StreamFormat m_format;
+    StreamBuffer m_buffer;
+
+    // Encoded bytes and decoded values exchanged with the file.
+    std::vector<char> m_bytes;
+    std::vector<double> m_values;
+
+private:
+    Stream(const Stream&) = delete;
+    Stream& operator =(const Stream&) = delete;
+};
+
+/**
+ * @brief Stream prefetched into a ring buffer.
+ * A single channel of the stream gets decoded, the frames being read
+ * by the evaluation thread without blocking.
+ */
+class StreamReader : public Stream
+{
+public:
+
+    StreamReader();
+    ~StreamReader() override;
+
+    /**
+     * @brief Open a file and fill the buffer.
+     * @param channel Channel (or CSV column) to read.
+     * @param capacity Frames buffered ahead.
+     * @return false if the file cannot be opened or its format is not supported.
+     */
+    bool open(StreamIO &io, const std::string &path, const StreamFormat &format,
+              std::size_t channel = 0, std::size_t capacity = DefaultCapacity);
+
+    /**
+     * @brief Read from a pipe or a socket (e.g. opened with fdopen()), which is not closed.
+     * Streams that cannot be rewound are made non-blocking until closed, so that
+     * the I/O thread only reads the data available.
+     */
+    bool open(StreamIO &io, std::FILE *pFile, const StreamFormat &format,
+              std::size_t channel = 0, std::size_t capacity = DefaultCapacity);
+
+    void close();
+
+    /// @return number of frames read, limited by the frames buffered.
+    std::size_t read(double *pFrames, std::size_t count) { return m_buffer.read(pFrames, count); }
+
+    /// Frames buffered ahead.
+    std::size_t available() const { return m_buffer.size(); }
+
+    /// Whether the end of the stream has been reached and all the frames read.
+    bool finished() const { return m_end.load(std::memory_order_acquire) && m_buffer.size() == 0; }
+
+    static constexpr std::size_t DefaultCapacity = 1 << 16;
+
+protected:
+
+    bool service() override;
+
+private:
+
+    bool readHeader();
+    bool readCsv(std::size_t frames);
+    bool readSamples(std::size_t frames);
+
+    std::size_t m_channel;
+    std::atomic<bool> m_end;
+
+    // Data bytes left in a WAV file.
+    std::uint64_t m_remaining;
+
+    // Bytes of the frame read in part, kept at the beginning of m_bytes.
+    std::size_t m_partial;
+
+    // Line read in part.
+    std::string m_line;
+
+    // Flags of the descriptor made non-blocking, or -1.
+    int m_flags;
+};
+
+/**
+ * @brief Stream drained from a ring buffer.
+ * The evaluation thread writes interleaved frames without blocking,
+ * the I/O thread encodes and writes them in batches.
+ */
+class StreamWriter : public Stream
+{
+public:
+
+    StreamWriter();
+    ~StreamWriter() override;
+
+    /**
+     * @brief Create a file.
+     * @param capacity Frames buffered behind.
+     */
+    bool open(StreamIO &io, const std::string &path, const StreamFormat &format,
+              std::size_t channels = 1, std::size_t capacity = DefaultCapacity);
+
+    /// Write to a pipe or a socket (e.g. opened with fdopen()), which is not closed.
+    bool open(StreamIO &io, std::FILE *pFile, const StreamFormat &format,
+              std::size_t channels = 1, std::size_t capacity = DefaultCapacity);
+
+    /// Write the frames left, and complete the file.
+    void close();
+
+    /// Number of channels of a frame.
+    std::size_t channels() const { return m_format.channels; }
+
+    /**
+     * @brief Queue interleaved frames.
+     * @return number of frames queued, limited by the buffer space.
+     */
+    std::size_t write(const double *pFrames, std::size_t count)
+    {
+        count = std::min(count, space());
+        m_buffer.write(pFrames, count * channels());
+        return count;
+    }
+
+    /// Room in the buffer, in frames.
+    std::size_t space() const { return m_buffer.space() / channels(); }
+
+    /// Have the I/O thread write the frames queued so far, rather than wait for a full batch.
+    void flush() { m_flush.store(true, std::memory_order_release); }
+
+    static constexpr std::size_t DefaultCapacity = 1 << 16;
+
+protected:
+
+    bool service() override;
+
+private:
+
+    // Encode and write the values queued, all of them or full batches only.
+    bool drain(bool all);
+
+    void writeHeader(std::uint64_t dataSize);
+
+    std::atomic<bool> m_flush;
+
+    // Bytes of samples written.
+    std::uint64_t m_written;
+};
+
+/**
+ * @brief Background thread servicing the streams.
+ * The thread wakes up periodically, reading ahead and writing behind
+ * the streams attached to it. It must outlive the streams. The lock is
+ * released while a stream gets serviced, so that the others can be
+ * attached and detached meanwhile.
+ */
+class StreamIO
+{
+public:
+
+    explicit StreamIO(std::chrono::microseconds period = std::chrono::milliseconds(1));
+    ~StreamIO();
+
+private:
+    StreamIO(const StreamIO&) = delete;
+    StreamIO& operator =(const StreamIO&) = delete;
+
+    friend class Stream;
+
+    void add(Stream *pStream);
+    void remove(Stream *pStream);
+
+    void run();
+
+    std::chrono::microseconds m_period;
+
+    // Streams attached, and the one being serviced, that cannot be detached yet.
+    std::vector<Stream*> m_streams;
+    Stream *m_pServiced;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_serviced;
+    bool m_stop;
+
+    std::thread m_thread;
+};
+
+namespace node {
+
+/**
+ * @brief Frames read from a stream.
+ * The output holds the last value when the buffer runs out of frames,
+ * which gets counted as underruns until the end of the stream.
+ *
+ * @code
+ * df::StreamIO io;
+ * auto &sensor = g.node<df::node::StreamSource<float> >();
+ * sensor.open(io, "recording.csv", df::StreamFormat::csv(), 2);
+ * @endcode
+ */
+template <typename T>
+class StreamSource : public Node,
+                     public Outputs<T>
+{
+public:
+
+    StreamSource(Graph &g)
+        : Node(g),
+          m_reader(),
+          m_frames(),
+          m_underruns(0)
+    {}
+
+    bool open(StreamIO &io, const std::string &path, const StreamFormat &format,
+              std::size_t channel = 0, std::size_t capacity = StreamReader::DefaultCapacity)
+    {
+        return m_reader.open(io, path, format, channel, capacity);
+    }
+
+    StreamReader& reader() { return m_reader; }
+
+    /// Frames missing while the stream has not finished.
+    std::size_t underruns() const { return m_underruns; }
+
+    void reserve(std::size_t frames) override
+    {
+        if (m_frames.size() < frames)
+            m_frames.resize(frames);
+    }
+
+    void evaluate() override
+    {
+        double value = 0.0;
+        if (m_reader.read(&value, 1) == 1)
+            Outputs<T>::firstOutput() = T(value);
+        else if (!m_reader.finished())
+            ++m_underruns;
+    }
+
+    void process(std::size_t frames) override
+    {
+        Output<T> &output = Outputs<T>::firstOutput();
+        T *out = output.block();
+        std::size_t count;
+
+        if (std::is_same<T, double>::value) {
+            count = m_reader.read(reinterpret_cast<double*>(out), frames);
+        } else {
+            count = m_reader.read(m_frames.data(), frames);
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = T(m_frames[i]);
+        }
+
+        if (count < frames) {
+            if (!m_reader.finished())
+                m_underruns += frames - count;
+            output.hold(count, frames);
+        }
+    }
+
+private:
+
+    StreamReader m_reader;
+
+    // Frames converted to the output type.
+    std::vector<double> m_frames;
+
+    std::size_t m_underruns;
+};
+
+/**
+ * @brief Frames written to a stream, one channel per input.
+ * The inputs must be added before opening the stream. Frames that do not
+ * fit into the buffer are dropped, and counted as overruns.
+ *
+ * @code
+ * auto &log = g.node<df::node::StreamSink<float> >(2);
+ * filter.out<0>() >> log.in(0);
+ * envelope.out<0>() >> log.in(1);
+ * log.open(io, "log.csv", df::StreamFormat::csv());
+ * @endcode
+ */
+template <typename T>
+class StreamSink : public Node,
+                   public InputArray<T>
+{
+public:
+
+    StreamSink(Graph &g, std::size_t channels = 1)
+        : Node(g),
+          InputArray<T>(*this, channels),
+          m_writer(),
+          m_frames(),
+          m_overruns(0)
+    {}
+
+    bool open(StreamIO &io, const std::string &path, const StreamFormat &format,
+              std::size_t capacity = StreamWriter::DefaultCapacity)
+    {
+        if (InputArray<T>::size() == 0)
+            return false;
+
+        reserve(graph().blockSize());
+        return m_writer.open(io, path, format, InputArray<T>::size(), capacity);
+    }
+
+    StreamWriter& writer() { return m_writer; }
+
+    /// Frames dropped for lack of room in the buffer.
+    std::size_t overruns() const { return m_overruns; }
+
+    void reserve(std::size_t frames) override
+    {
+        const std::size_t size = std::max<std::size_t>(frames, 1) * InputArray<T>::size();
+        if (m_frames.size() < size)
+            m_frames.resize(size);
+    }
+
+    void evaluate() override
+    {
+        if (!writable())
+            return;
+
+        for (std::size_t c = 0; c < m_writer.channels(); ++c)
+            m_frames[c] = double(InputArray<T>::in(c).value());
+
+        m_overruns += 1 - m_writer.write(m_frames.data(), 1);
+    }
+
+    void process(std::size_t frames) override
+    {
+        if (!writable())
+            return;
+
+        const std::size_t channels = m_writer.channels();
+        for (std::size_t c = 0; c < channels; ++c) {
+            const T *in = InputArray<T>::in(c).block();
+            for (std::size_t i = 0; i < frames; ++i)
+                m_frames[i * channels + c] = double(in[i]);
+        }
+
+        m_overruns += frames - m_writer.write(m_frames.data(), frames);
+    }
+
+private:
+
+    // Inputs removed once open are not written.
+    bool writable() const { return m_writer.isOpen() && m_writer.channels() <= InputArray<T>::size(); }
+
+    StreamWriter m_writer;
+
+    // Interleaved frames.
+    std::vector<double> m_frames;
+
+    std::size_t m_overruns;
+};
+
+} // namespace node
+} // namespace df
+
+#endif // DF_STREAM_H_INCLUDED
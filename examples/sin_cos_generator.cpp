@@ -45,6 +45,7 @@ void example_sin_cos_generator()
 
     // Integration time step
     auto& dt = g.variable<float>(g.timeStep());
+    dt.constant(true);
 
     // Data flow nodes
     auto &csub = g.sub<float>();